@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#ifdef FILESYS
+#include "filesys/cache.h"
+#endif
 
 /* A block device. */
 struct block
@@ -139,6 +142,97 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Returns the total number of sectors in the IOV_CNT pieces of
+   IOV. */
+static size_t
+iovec_sectors (const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    cnt += iov[i].sector_cnt;
+  return cnt;
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Drivers that support it move all of the sectors with as few
+   commands as possible. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.buffer = buffer;
+  iov.sector_cnt = cnt;
+  block_readv (block, sector, &iov, 1);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.buffer = (void *) buffer;
+  iov.sector_cnt = cnt;
+  block_writev (block, sector, &iov, 1);
+}
+
+/* Reads consecutive sectors starting at SECTOR from BLOCK into the
+   IOV_CNT pieces of IOV, in order. */
+void
+block_readv (struct block *block, block_sector_t sector,
+             const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t cnt = iovec_sectors (iov, iov_cnt);
+  size_t i, j;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->readv != NULL)
+    block->ops->readv (block->aux, sector, iov, iov_cnt);
+  else
+    for (i = 0; i < iov_cnt; i++)
+      for (j = 0; j < iov[i].sector_cnt; j++)
+        block->ops->read (block->aux, sector++,
+                          (uint8_t *) iov[i].buffer + j * BLOCK_SECTOR_SIZE);
+  block->read_cnt += cnt;
+}
+
+/* Writes consecutive sectors starting at SECTOR to BLOCK from the
+   IOV_CNT pieces of IOV, in order.  Returns after the block device
+   has acknowledged receiving all of the data. */
+void
+block_writev (struct block *block, block_sector_t sector,
+              const struct block_iovec *iov, size_t iov_cnt)
+{
+  size_t cnt = iovec_sectors (iov, iov_cnt);
+  size_t i, j;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->writev != NULL)
+    block->ops->writev (block->aux, sector, iov, iov_cnt);
+  else
+    for (i = 0; i < iov_cnt; i++)
+      for (j = 0; j < iov[i].sector_cnt; j++)
+        block->ops->write (block->aux, sector++,
+                           (uint8_t *) iov[i].buffer + j * BLOCK_SECTOR_SIZE);
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -176,6 +270,9 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+#ifdef FILESYS
+  cache_print_stats ();
+#endif
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -49,10 +49,27 @@ struct block *block_get_by_name (const char *name);
 struct block *block_first (void);
 struct block *block_next (struct block *);
 
+/* One piece of a scatter-gather transfer: SECTOR_CNT whole
+   sectors' worth of memory starting at BUFFER.  The pieces of a
+   transfer map consecutive sectors on the device. */
+struct block_iovec
+  {
+    void *buffer;                /* Memory to read into or write from. */
+    size_t sector_cnt;           /* Number of sectors in BUFFER. */
+  };
+
 /* Block device operations. */
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_readv (struct block *, block_sector_t,
+                  const struct block_iovec *, size_t iov_cnt);
+void block_writev (struct block *, block_sector_t,
+                   const struct block_iovec *, size_t iov_cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
@@ -61,10 +78,17 @@ void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* READV and WRITEV are optional.  A driver that can move several
+   sectors per command should provide them; otherwise the block
+   layer falls back to one READ or WRITE per sector. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*readv) (void *aux, block_sector_t,
+                   const struct block_iovec *, size_t iov_cnt);
+    void (*writev) (void *aux, block_sector_t,
+                    const struct block_iovec *, size_t iov_cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -1,5 +1,6 @@
 #include "devices/ide.h"
 #include <ctype.h>
+#include <list.h>
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -8,10 +9,14 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If the
+   controller is a PCI bus master, such as the PIIX that QEMU
+   emulates, data moves by DMA; otherwise, by PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +35,33 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prd(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus Master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_ERROR 0x02           /* Transfer failed (write 1 to clear). */
+#define BM_INTR 0x04            /* Disk interrupted (write 1 to clear). */
+
+/* PCI configuration space ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* PCI Command Register bits. */
+#define PCI_COMMAND_IO 0x0001           /* Respond to I/O accesses. */
+#define PCI_COMMAND_MASTER 0x0004       /* Allow bus mastering. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +77,19 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors that one command can transfer, given that the
+   Sector Count register is 8 bits wide and 0 means 256. */
+#define MAX_COMMAND_SECTORS 256
+
+/* Longest that a PIO write waits, with interrupts off, for the disk
+   to ask for the next block of data, in microseconds. */
+#define DRQ_POLL_US 1000
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +98,54 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 0 if not supported. */
+    bool dma;                   /* Use bus master DMA? */
+    block_sector_t head;        /* Sector after the last one transferred,
+                                   where the elevator resumes. */
   };
 
+/* A request to transfer sectors between a disk and memory, queued
+   on the disk's channel.  Pending requests for adjacent sectors in
+   the same direction are merged into a chain that the channel
+   transfers as if it were a single request; only the head of a
+   chain is in the queue. */
+struct ide_request
+  {
+    struct list_elem elem;              /* Element in channel's queue. */
+    struct ata_disk *disk;              /* Disk to transfer with. */
+    bool writing;                       /* Write to disk, or read? */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    const struct block_iovec *iov;      /* Memory for the CNT sectors. */
+    struct ide_request *next;           /* Next request in chain. */
+    struct ide_request *tail;           /* Last request in chain (head only). */
+    size_t chain_cnt;                   /* Sectors in chain (head only). */
+    struct semaphore done;              /* Up'd when transfer completes. */
+  };
+
+/* A position within a scatter-gather list. */
+struct iov_pos
+  {
+    const struct block_iovec *iov;      /* Current piece. */
+    size_t sector;                      /* Sector within the piece. */
+  };
+
+/* Most sectors that merging may gather into one chain, so that a
+   long run of merges cannot hold up other requests forever. */
+#define MAX_CHAIN_SECTORS 256
+
+/* A Physical Region Descriptor: one piece of memory for a bus
+   master transfer.  A piece must not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, word aligned. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -67,11 +154,26 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Request queue.  Shared with the interrupt handler, so
+       accessed only with interrupts off. */
+    struct list queue;          /* Pending chains of requests. */
+    struct ide_request *active; /* Chain in progress, or null if idle. */
+    struct ide_request *cur;    /* Request in ACTIVE that POS is in. */
+    struct iov_pos pos;         /* Memory for the next sector. */
+    size_t cur_left;            /* Sectors left in CUR's memory. */
+    block_sector_t sector;      /* Next sector of ACTIVE to transfer. */
+    size_t left;                /* Sectors of ACTIVE left to transfer. */
+    size_t cmd_left;            /* Sectors left in the current command. */
+    size_t block_cnt;           /* Sectors in the PIO block in progress. */
+    bool cmd_dma;               /* Current command uses DMA? */
+
+    uint16_t bm_base;           /* Bus master base port, 0 if no DMA. */
+    struct prd *prd;            /* PRD table of PRD_CNT entries. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,17 +183,21 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int max_multiple);
+
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static bool wait_for_drq (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
@@ -101,6 +207,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +230,21 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      list_init (&c->queue);
+      c->active = NULL;
+
+      /* Each channel has 8 bus master ports and needs a PRD table,
+         which must not cross a 64 kB boundary. */
+      c->bm_base = 0;
+      c->prd = NULL;
+      if (bm_base != 0)
+        {
+          c->prd = palloc_get_page (0);
+          if (c->prd != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +255,9 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          d->head = 0;
         }
 
       /* Register interrupt handler. */
@@ -155,6 +277,71 @@ ide_init (void)
     }
 }
 
+/* Reads the 32-bit register at offset REG in the configuration
+   space of PCI function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at offset REG in the
+   configuration space of PCI function FUNC of device DEV on bus
+   BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master, such as the PIIX3 that QEMU emulates, and enables bus
+   mastering on it.  Returns the base I/O port of its bus master
+   registers, or 0 if there is no such controller, in which case
+   all transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4, command;
+
+        if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+          {
+            /* No such function.  If function 0 is missing, so is
+               the device. */
+            if (func == 0)
+              break;
+            continue;
+          }
+
+        /* Class 01h, subclass 01h is an IDE controller.  Bit 7 of
+           the programming interface says that it can be a bus
+           master. */
+        class = pci_read_config (0, dev, func, 0x08);
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        /* BAR4 holds the bus master ports, if assigned. */
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        command = pci_read_config (0, dev, func, 0x04) & 0xffff;
+        pci_write_config (0, dev, func, 0x04,
+                          command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -303,6 +490,13 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Word 47 gives the most sectors per interrupt that READ/WRITE
+     MULTIPLE supports, if any. */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+
+  /* Bit 8 of word 49 says that the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
@@ -337,63 +531,453 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Enables READ/WRITE MULTIPLE on disk D with blocks of
+   MAX_MULTIPLE sectors, which is the most the disk supports.  On
+   success, sets D's multiple member; otherwise, D keeps
+   transferring one sector per interrupt. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+set_multiple_mode (struct ata_disk *d, int max_multiple)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+
+  if (max_multiple == 0)
+    return;
+  select_device_wait (d);
+  outb (reg_nsect (c), max_multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
   sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = max_multiple;
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Returns the buffer for the sector at POS and advances POS to
+   the next sector. */
+static void *
+next_sector (struct iov_pos *pos)
+{
+  while (pos->sector >= pos->iov->sector_cnt)
+    {
+      pos->iov++;
+      pos->sector = 0;
+    }
+  return (uint8_t *) pos->iov->buffer + pos->sector++ * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the buffer for the next sector of channel C's active
+   chain and advances to the sector after it, moving on to the
+   next request in the chain as needed. */
+static void *
+chain_next_sector (struct channel *c)
+{
+  if (c->cur_left == 0)
+    {
+      c->cur = c->cur->next;
+      c->pos.iov = c->cur->iov;
+      c->pos.sector = 0;
+      c->cur_left = c->cur->cnt;
+    }
+  c->cur_left--;
+  return next_sector (&c->pos);
+}
+
+/* Appends the SIZE bytes at BUFFER to the PRD table of channel C,
+   which has *PRD_CNT entries in use, merging them into the last
+   entry if they follow it in physical memory.  Returns false if
+   BUFFER is not suitable for DMA or the table is full. */
+static bool
+add_prd (struct channel *c, size_t *prd_cnt, const void *buffer, size_t size)
+{
+  uint32_t addr;
+
+  if (!is_kernel_vaddr (buffer))
+    return false;
+  addr = vtop (buffer);
+  if (addr & 1)
+    return false;
+
+  while (size > 0)
+    {
+      /* Stop each piece at the next 64 kB boundary. */
+      size_t chunk = 0x10000 - (addr & 0xffff);
+      struct prd *last = *prd_cnt > 0 ? &c->prd[*prd_cnt - 1] : NULL;
+      size_t last_size = 0;
+
+      if (last != NULL)
+        last_size = last->size != 0 ? last->size : 0x10000;
+      if (chunk > size)
+        chunk = size;
+      if (last != NULL && last->addr + last_size == addr
+          && (last->addr >> 16) == (addr >> 16))
+        last->size = (last_size + chunk) & 0xffff;
+      else if (*prd_cnt < PRD_CNT)
+        {
+          struct prd *p = &c->prd[(*prd_cnt)++];
+          p->addr = addr;
+          p->size = chunk & 0xffff;
+          p->flags = 0;
+        }
+      else
+        return false;
+      addr += chunk;
+      size -= chunk;
+    }
+  return true;
+}
+
+/* Tries to start the next CMD_LEFT sectors of channel C's active
+   chain as a bus master DMA command.  Returns false, leaving C's
+   position unchanged, if that memory cannot be used for DMA, in
+   which case the caller should fall back to PIO. */
+static bool
+start_dma (struct channel *c)
+{
+  struct ata_disk *d = c->active->disk;
+  bool writing = c->active->writing;
+  uint8_t direction = writing ? 0 : BM_READ;
+  struct ide_request *cur = c->cur;
+  struct iov_pos pos = c->pos;
+  size_t cur_left = c->cur_left;
+  size_t prd_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < c->cmd_left; i++)
+    if (!add_prd (c, &prd_cnt, chain_next_sector (c), BLOCK_SECTOR_SIZE))
+      {
+        c->cur = cur;
+        c->pos = pos;
+        c->cur_left = cur_left;
+        return false;
+      }
+  c->prd[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the bus master, then the disk, then start. */
+  outl (reg_bm_prd (c), vtop (c->prd));
+  outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+  outb (reg_bm_command (c), direction);
+  select_sector (d, c->sector, c->cmd_left);
+  outb (reg_command (c), writing ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_START);
+  return true;
+}
+
+/* Writes the next block of the PIO write command in progress on
+   channel C, once the disk is ready to take it.  Called from the
+   interrupt handler, where waiting for the disk to raise DRQ is
+   the only busy-wait apart from select_sector()'s idle checks,
+   which pass at once after a command completes.  It is bounded
+   by DRQ_POLL_US. */
+static void
+output_block (struct channel *c)
+{
+  struct ata_disk *d = c->active->disk;
+  size_t per_block = d->multiple > 0 ? d->multiple : 1;
+  size_t i;
+
+  c->block_cnt = c->cmd_left < per_block ? c->cmd_left : per_block;
+  if (!wait_for_drq (d))
+    PANIC ("%s: disk not ready for write data within %d us, "
+           "sector=%"PRDSNu, d->name, DRQ_POLL_US, c->sector);
+  for (i = 0; i < c->block_cnt; i++)
+    output_sector (c, chain_next_sector (c));
+}
+
+/* Starts a command for the next sectors of channel C's active
+   chain, by DMA if possible and by PIO otherwise.  The interrupt
+   handler carries it on from there. */
+static void
+start_command (struct channel *c)
+{
+  struct ata_disk *d = c->active->disk;
+  bool writing = c->active->writing;
+  uint8_t command;
+
+  c->cmd_left = c->left < MAX_COMMAND_SECTORS ? c->left : MAX_COMMAND_SECTORS;
+  c->block_cnt = 0;
+  c->cmd_dma = d->dma && start_dma (c);
+  if (c->cmd_dma)
+    return;
+
+  if (d->multiple > 0)
+    command = writing ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+  else
+    command = writing ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+  select_sector (d, c->sector, c->cmd_left);
+  outb (reg_command (c), command);
+  if (writing)
+    output_block (c);
+}
+
+/* Returns the chain in channel C's queue that a C-LOOK elevator
+   serves next: the one with the lowest first sector at or past
+   its disk's head, or if there is none, the one with the lowest
+   first sector overall, so that the head sweeps upward and then
+   jumps back.  Returns a null pointer if the queue is empty. */
+static struct ide_request *
+pick_request (struct channel *c)
+{
+  struct ide_request *ahead = NULL, *lowest = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *r = list_entry (e, struct ide_request, elem);
+
+      if (lowest == NULL || r->sector < lowest->sector)
+        lowest = r;
+      if (r->sector >= r->disk->head
+          && (ahead == NULL || r->sector < ahead->sector))
+        ahead = r;
+    }
+  return ahead != NULL ? ahead : lowest;
+}
+
+/* If channel C is idle, starts on the next chain in its queue.
+   Must be called with interrupts off. */
+static void
+dispatch (struct channel *c)
+{
+  struct ide_request *r;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->active != NULL)
+    return;
+  r = pick_request (c);
+  if (r == NULL)
+    return;
+  list_remove (&r->elem);
+
+  c->active = r;
+  c->cur = r;
+  c->pos.iov = r->iov;
+  c->pos.sector = 0;
+  c->cur_left = r->cnt;
+  c->sector = r->sector;
+  c->left = r->chain_cnt;
+  start_command (c);
+}
+
+/* Wakes up every requester in channel C's active chain, which has
+   been transferred in full, and starts on the next chain.  Called
+   by the interrupt handler. */
+static void
+complete_chain (struct channel *c)
+{
+  struct ide_request *r = c->active;
+
+  r->disk->head = r->sector + r->chain_cnt;
+  c->active = NULL;
+  while (r != NULL)
+    {
+      /* R may vanish as soon as its requester wakes up. */
+      struct ide_request *next = r->next;
+      sema_up (&r->done);
+      r = next;
+    }
+  dispatch (c);
+}
+
+/* Carries on channel C's active chain after the interrupt that
+   the disk raises when a DMA command finishes, when a PIO block
+   is ready to read, or when a written PIO block has been taken.
+   STATUS is the disk's status. */
+static void
+continue_transfer (struct channel *c, uint8_t status)
+{
+  struct ata_disk *d = c->active->disk;
+  bool writing = c->active->writing;
+  size_t done;
+
+  if (c->cmd_dma)
+    {
+      uint8_t bm_status;
+
+      outb (reg_bm_command (c), 0);
+      bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+      if ((bm_status & BM_ERROR) != 0 || (status & STA_ERR) != 0)
+        PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu, d->name,
+               writing ? "write" : "read", c->sector);
+      done = c->cmd_left;
+    }
+  else if (writing)
+    {
+      if ((status & STA_ERR) != 0)
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, c->sector);
+      done = c->block_cnt;
+    }
+  else
+    {
+      size_t per_block = d->multiple > 0 ? d->multiple : 1;
+      size_t i;
+
+      if ((status & (STA_ERR | STA_DRQ)) != STA_DRQ)
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, c->sector);
+      done = c->cmd_left < per_block ? c->cmd_left : per_block;
+      for (i = 0; i < done; i++)
+        input_sector (c, chain_next_sector (c));
+    }
+
+  c->sector += done;
+  c->left -= done;
+  c->cmd_left -= done;
+  if (c->cmd_left > 0)
+    {
+      if (writing)
+        output_block (c);
+    }
+  else if (c->left > 0)
+    start_command (c);
+  else
+    complete_chain (c);
+}
+
+/* Tries to merge request R into a pending chain in channel C's
+   queue that reads or writes the sectors just before or just after
+   R's.  Returns true if successful.  Must be called with
+   interrupts off. */
+static bool
+merge_request (struct channel *c, struct ide_request *r)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct ide_request *q = list_entry (e, struct ide_request, elem);
+
+      if (q->disk != r->disk || q->writing != r->writing
+          || q->chain_cnt + r->cnt > MAX_CHAIN_SECTORS)
+        continue;
+      if (q->sector + q->chain_cnt == r->sector)
+        {
+          /* R follows Q's chain. */
+          q->tail->next = r;
+          q->tail = r;
+          q->chain_cnt += r->cnt;
+          return true;
+        }
+      if (r->sector + r->cnt == q->sector)
+        {
+          /* R precedes Q's chain, so R becomes its head. */
+          r->next = q;
+          r->tail = q->tail;
+          r->chain_cnt = r->cnt + q->chain_cnt;
+          list_insert (&q->elem, &r->elem);
+          list_remove (&q->elem);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Transfers consecutive sectors starting at SEC_NO between disk D
+   and the IOV_CNT pieces of IOV, writing to the disk if WRITING is
+   true and reading from it otherwise.  The request joins the
+   queue of D's channel and the calling thread sleeps until the
+   interrupt handler has completed it.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct block_iovec *iov, size_t iov_cnt, bool writing)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct ide_request r;
+  enum intr_level old_level;
+  size_t i;
+
+  r.disk = d;
+  r.writing = writing;
+  r.sector = sec_no;
+  r.cnt = 0;
+  for (i = 0; i < iov_cnt; i++)
+    r.cnt += iov[i].sector_cnt;
+  r.iov = iov;
+  r.next = NULL;
+  r.tail = &r;
+  r.chain_cnt = r.cnt;
+  sema_init (&r.done, 0);
+  if (r.cnt == 0)
+    return;
+
+  old_level = intr_disable ();
+  if (!merge_request (c, &r))
+    list_push_back (&c->queue, &r.elem);
+  dispatch (c);
+  intr_set_level (old_level);
+
+  sema_down (&r.done);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.buffer = buffer;
+  iov.sector_cnt = 1;
+  ide_transfer (d, sec_no, &iov, 1, false);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.buffer = (void *) buffer;
+  iov.sector_cnt = 1;
+  ide_transfer (d, sec_no, &iov, 1, true);
+}
+
+/* Reads consecutive sectors starting at SEC_NO from disk D into
+   the IOV_CNT pieces of IOV. */
+static void
+ide_readv (void *d, block_sector_t sec_no,
+           const struct block_iovec *iov, size_t iov_cnt)
+{
+  ide_transfer (d, sec_no, iov, iov_cnt, false);
+}
+
+/* Writes consecutive sectors starting at SEC_NO to disk D from the
+   IOV_CNT pieces of IOV.  Returns after the disk has acknowledged
+   receiving all of the data. */
+static void
+ide_writev (void *d, block_sector_t sec_no,
+            const struct block_iovec *iov, size_t iov_cnt)
+{
+  ide_transfer (d, sec_no, iov, iov_cnt, true);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_readv,
+    ide_writev
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO to the disk's sector selection registers and CNT,
+   which must be between 1 and MAX_COMMAND_SECTORS, to its Sector
+   Count register.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_COMMAND_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_COMMAND_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -446,7 +1030,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -479,6 +1063,28 @@ wait_while_busy (const struct ata_disk *d)
   return false;
 }
 
+/* Wait up to DRQ_POLL_US microseconds for disk D to clear BSY,
+   and then return the status of the DRQ bit.  Unlike
+   wait_while_busy(), never sleeps, so it may be called with
+   interrupts off and from the interrupt handler.  A disk raises
+   DRQ within microseconds of being ready for data, so the poll is
+   kept short to avoid stalling the kernel. */
+static bool
+wait_for_drq (const struct ata_disk *d)
+{
+  struct channel *c = d->channel;
+  int i;
+
+  for (i = 0; i < DRQ_POLL_US / 10; i++)
+    {
+      uint8_t status = inb (reg_alt_status (c));
+      if (!(status & STA_BSY))
+        return (status & STA_DRQ) != 0;
+      timer_udelay (10);
+    }
+  return false;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
@@ -489,7 +1095,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -502,7 +1108,9 @@ select_device_wait (const struct ata_disk *d)
   wait_until_idle (d);
 }
 
-/* ATA interrupt handler. */
+/* ATA interrupt handler.  Carries on the channel's active
+   request, if any, or else wakes up a thread waiting for a
+   command issued with issue_pio_command(). */
 static void
 interrupt_handler (struct intr_frame *f) 
 {
@@ -511,7 +1119,9 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (c->active != NULL)
+          continue_transfer (c, inb (reg_status (c)));
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
@@ -523,5 +1133,3 @@ interrupt_handler (struct intr_frame *f)
 
   NOT_REACHED ();
 }
-
-
@@ -0,0 +1,688 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <round.h>
+#include "filesys/checksum.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* A sector held in the buffer cache.
+
+   SECTOR and IN_USE change only while holding both cache_lock
+   and the entry's LOCK, so either one is enough to read them.
+   DATA, DIRTY and JOURNALED are protected by LOCK alone.
+
+   An entry in use is in cache_map.  A dirty entry being evicted
+   is instead in evict_map, not in use, until it has been written
+   back. */
+struct cache_entry
+  {
+    struct hash_elem hash_elem;         /* Element in cache_map or
+                                           evict_map. */
+    block_sector_t sector;              /* Sector held, if IN_USE. */
+    bool in_use;                        /* Holds a sector? */
+    bool dirty;                         /* Modified since read from disk? */
+    bool accessed;                      /* Used since the clock hand passed? */
+    bool journaled;                     /* Held back until journal commit? */
+    struct lock lock;                   /* Protects DATA and DIRTY. */
+    uint8_t *data;                      /* Sector contents. */
+  };
+
+/* Number of entries, set by cache_configure(). */
+static size_t cache_cnt = CACHE_DEFAULT_SECTORS;
+
+/* Array of CACHE_CNT entries. */
+static struct cache_entry *cache;
+
+/* Maps a sector number to the entry that holds it. */
+static struct hash cache_map;
+
+/* Maps a sector number to the evicted entry whose old contents are
+   being written back to it.  Until the write finishes, the sector
+   must not be read from disk. */
+static struct hash evict_map;
+
+/* Protects CACHE_MAP, EVICT_MAP and CLOCK_HAND. */
+static struct lock cache_lock;
+
+/* Next entry for the clock algorithm to consider for eviction. */
+static size_t clock_hand;
+
+/* Number of dirty entries, and the number above which writers
+   flush the cache themselves instead of leaving the work to the
+   write-behind thread. */
+static size_t dirty_cnt;
+static size_t dirty_high_water;
+static struct lock dirty_lock;          /* Protects DIRTY_CNT. */
+
+/* Most sectors written or read ahead with one block device
+   request. */
+#define RUN_MAX 32
+
+/* Scratch arrays used by cache_flush() to order dirty entries by
+   sector and to gather runs of them.  FLUSH_LOCK serializes their
+   users. */
+static struct cache_entry **flush_order;
+static struct cache_entry *flush_run[RUN_MAX];
+static struct block_iovec flush_iov[RUN_MAX];
+static struct lock flush_lock;
+
+/* Sectors queued for the read-ahead thread, as a ring buffer.
+   READ_AHEAD_SEMA counts the queued sectors. */
+#define READ_AHEAD_SLOTS 64
+static block_sector_t read_ahead_queue[READ_AHEAD_SLOTS];
+static size_t read_ahead_head;          /* Next slot to fill. */
+static size_t read_ahead_cnt;           /* Number of queued sectors. */
+static struct lock read_ahead_lock;     /* Protects the queue. */
+static struct semaphore read_ahead_sema;
+
+/* Statistics. */
+static unsigned long long hit_cnt;      /* Lookups satisfied in memory. */
+static unsigned long long miss_cnt;     /* Lookups that needed a slot. */
+
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
+static struct cache_entry *map_lookup (struct hash *, block_sector_t);
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static struct cache_entry *cache_claim (block_sector_t);
+static void mark_dirty (struct cache_entry *);
+static void write_back (struct cache_entry *);
+static thread_func read_ahead NO_RETURN;
+
+/* Sets the number of sectors that cache_init() will allocate.
+   Called while parsing the kernel command line, before the
+   cache is initialized.  Sizes below CACHE_MIN_SECTORS are raised
+   to it. */
+void
+cache_configure (size_t sectors)
+{
+  ASSERT (cache == NULL);
+  if (sectors > 0)
+    cache_cnt = sectors < CACHE_MIN_SECTORS ? CACHE_MIN_SECTORS : sectors;
+}
+
+/* Sets the number of dirty sectors above which a writer must
+   flush the cache before it continues.  Called while parsing the
+   kernel command line, before the cache is initialized. */
+void
+cache_configure_high_water (size_t sectors)
+{
+  ASSERT (cache == NULL);
+  dirty_high_water = sectors;
+}
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  size_t page_cnt = DIV_ROUND_UP (cache_cnt * BLOCK_SECTOR_SIZE, PGSIZE);
+  uint8_t *data;
+  size_t i;
+
+  /* Sector buffers come from whole pages, so that none of them
+     straddles a page boundary. */
+  cache = calloc (cache_cnt, sizeof *cache);
+  flush_order = calloc (cache_cnt, sizeof *flush_order);
+  data = palloc_get_multiple (0, page_cnt);
+  if (cache == NULL || flush_order == NULL || data == NULL
+      || !hash_init (&cache_map, cache_hash, cache_less, NULL)
+      || !hash_init (&evict_map, cache_hash, cache_less, NULL))
+    PANIC ("buffer cache allocation failed");
+  for (i = 0; i < cache_cnt; i++)
+    {
+      lock_init (&cache[i].lock);
+      cache[i].data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  lock_init (&dirty_lock);
+  lock_init (&flush_lock);
+  clock_hand = 0;
+  if (dirty_high_water == 0 || dirty_high_water > cache_cnt)
+    dirty_high_water = cache_cnt * 3 / 4;
+
+  lock_init (&read_ahead_lock);
+  sema_init (&read_ahead_sema, 0);
+  if (thread_create ("read-ahead", PRI_DEFAULT, read_ahead, NULL)
+      == TID_ERROR)
+    PANIC ("can't start read-ahead thread");
+}
+
+/* Compares the sectors held by the cache entries that A_ and B_
+   point to, for sorting with sort(). */
+static int
+compare_sectors (const void *a_, const void *b_, void *aux UNUSED)
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes the CNT entries in flush_run, which hold consecutive
+   sectors and whose locks the caller holds, back to disk with a
+   single request, and releases their locks. */
+static void
+write_run (size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      checksum_update (flush_run[i]->sector, flush_run[i]->data);
+      flush_iov[i].buffer = flush_run[i]->data;
+      flush_iov[i].sector_cnt = 1;
+    }
+  block_writev (fs_device, flush_run[0]->sector, flush_iov, cnt);
+
+  lock_acquire (&dirty_lock);
+  dirty_cnt -= cnt;
+  lock_release (&dirty_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      flush_run[i]->dirty = false;
+      lock_release (&flush_run[i]->lock);
+    }
+}
+
+/* Writes every dirty sector in the cache back to disk, in
+   ascending sector order to keep disk head movement short.  Runs
+   of consecutive sectors go to the disk as single requests.
+   Sectors held back for the journal stay in the cache. */
+void
+cache_flush (void)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&flush_lock);
+
+  /* Take an unlocked snapshot of the dirty entries.  An entry may
+     change before we lock it, so each is rechecked below.  Dirty
+     entries not in use are being written back by cache_evict();
+     locking them waits for that write to finish. */
+  for (i = 0; i < cache_cnt; i++)
+    if (cache[i].dirty && !cache[i].journaled)
+      flush_order[cnt++] = &cache[i];
+  sort (flush_order, cnt, sizeof *flush_order, compare_sectors, NULL);
+
+  i = 0;
+  while (i < cnt)
+    {
+      size_t run = 0;
+
+      /* Lock a run of entries that are still dirty and hold
+         consecutive sectors.  No other thread waits for an entry
+         lock while holding one, so holding several cannot
+         deadlock. */
+      for (; i < cnt && run < RUN_MAX; i++)
+        {
+          struct cache_entry *e = flush_order[i];
+
+          lock_acquire (&e->lock);
+          if (!e->in_use || !e->dirty || e->journaled)
+            lock_release (&e->lock);
+          else if (run > 0 && e->sector != flush_run[0]->sector + run)
+            {
+              /* Start the next run with E. */
+              lock_release (&e->lock);
+              break;
+            }
+          else
+            flush_run[run++] = e;
+        }
+      if (run > 0)
+        write_run (run);
+    }
+
+  lock_release (&flush_lock);
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Copies SIZE bytes starting at byte offset OFS within SECTOR
+   into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR, starting at byte
+   offset OFS within the sector.  The data reaches the disk when
+   the sector is evicted or the cache is flushed. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  /* A write that covers the whole sector need not read it first. */
+  e = cache_get (sector, ofs != 0 || size != BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  mark_dirty (e);
+  lock_release (&e->lock);
+
+  /* Stall only if the write-behind thread has fallen too far
+     behind. */
+  if (dirty_cnt > dirty_high_water)
+    cache_flush ();
+}
+
+/* Like cache_write_at(), but also holds SECTOR back from the disk
+   until cache_release_journaled() is called for it, so that the
+   journal can commit it first.  Does not stall for the
+   write-behind thread, since that cannot write SECTOR anyway. */
+void
+cache_write_journaled (block_sector_t sector, const void *buffer,
+                       size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, ofs != 0 || size != BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->journaled = true;
+  mark_dirty (e);
+  lock_release (&e->lock);
+}
+
+/* Lets SECTOR, which cache_write_journaled() held back, be written
+   to disk again. */
+void
+cache_release_journaled (block_sector_t sector)
+{
+  struct cache_entry *e = cache_get (sector, true);
+  e->journaled = false;
+  lock_release (&e->lock);
+}
+
+/* Returns the number of sectors the buffer cache holds. */
+size_t
+cache_size (void)
+{
+  return cache_cnt;
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache in
+   the background.  Returns without waiting.  The request is
+   dropped if the read-ahead queue is full. */
+void
+cache_prefetch (block_sector_t sector)
+{
+  bool queued = false;
+
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_SLOTS)
+    {
+      read_ahead_queue[read_ahead_head] = sector;
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_SLOTS;
+      read_ahead_cnt++;
+      queued = true;
+    }
+  lock_release (&read_ahead_lock);
+
+  if (queued)
+    sema_up (&read_ahead_sema);
+}
+
+/* Removes the oldest sector from the read-ahead queue and stores
+   it in *SECTOR.  If NEXT_ONLY is true, does so only if that sector
+   is NEXT.  Returns true if a sector was removed. */
+static bool
+dequeue_read_ahead (block_sector_t *sector, bool next_only,
+                    block_sector_t next)
+{
+  bool found = false;
+
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt > 0)
+    {
+      size_t tail = ((read_ahead_head + READ_AHEAD_SLOTS - read_ahead_cnt)
+                     % READ_AHEAD_SLOTS);
+      if (!next_only || read_ahead_queue[tail] == next)
+        {
+          *sector = read_ahead_queue[tail];
+          read_ahead_cnt--;
+          found = true;
+        }
+    }
+  lock_release (&read_ahead_lock);
+  return found;
+}
+
+/* Read-ahead thread.  Loads the sectors queued by
+   cache_prefetch(), oldest first.  Queued sectors that are
+   consecutive on disk are read with a single request. */
+static void
+read_ahead (void *aux UNUSED)
+{
+  static struct cache_entry *run[RUN_MAX];
+  static struct block_iovec iov[RUN_MAX];
+
+  for (;;)
+    {
+      block_sector_t sector;
+      size_t cnt = 0;
+      size_t i;
+
+      /* The semaphore may run ahead of the queue, since the sectors
+         that extend a run are taken without downing it. */
+      sema_down (&read_ahead_sema);
+      if (!dequeue_read_ahead (&sector, false, 0))
+        continue;
+
+      /* Claim entries for as many consecutive sectors as are
+         queued, stopping at one that is already cached. */
+      do
+        {
+          struct cache_entry *e = cache_claim (sector);
+          if (e == NULL)
+            break;
+          run[cnt] = e;
+          iov[cnt].buffer = e->data;
+          iov[cnt].sector_cnt = 1;
+          cnt++;
+        }
+      while (cnt < RUN_MAX
+             && dequeue_read_ahead (&sector, true, run[0]->sector + cnt));
+
+      if (cnt == 0)
+        continue;
+      block_readv (fs_device, run[0]->sector, iov, cnt);
+      for (i = 0; i < cnt; i++)
+        {
+          /* Drop a sector that fails its checksum, so that the
+             reader who wants it reads it again itself. */
+          if (!checksum_verify (run[i]->sector, run[i]->data))
+            {
+              lock_acquire (&cache_lock);
+              hash_delete (&cache_map, &run[i]->hash_elem);
+              run[i]->in_use = false;
+              lock_release (&cache_lock);
+            }
+          lock_release (&run[i]->lock);
+        }
+    }
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Buffer cache: %llu hits, %llu misses\n", hit_cnt, miss_cnt);
+}
+
+/* Returns the entry in MAP for SECTOR, or a null pointer if there
+   is none.  Caller must hold cache_lock. */
+static struct cache_entry *
+map_lookup (struct hash *map, block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (map, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, hash_elem) : NULL;
+}
+
+/* Chooses an entry to replace using the clock algorithm, skipping
+   entries that another thread is using or that are held back for
+   the journal, and removes it from cache_map.  Returns the victim
+   with its lock held, or a null pointer if every entry is busy.
+
+   Caller must hold cache_lock.  A dirty victim is written back
+   with cache_lock released, meanwhile parked in evict_map so that
+   nobody reads a stale copy of its sector from disk, so the caller
+   must check again that the sector it wants is not cached. */
+static struct cache_entry *
+cache_evict (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * cache_cnt; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % cache_cnt;
+
+      if (!lock_try_acquire (&e->lock))
+        continue;
+      if (e->in_use && e->journaled)
+        {
+          lock_release (&e->lock);
+          continue;
+        }
+      if (e->in_use && e->accessed)
+        {
+          e->accessed = false;
+          lock_release (&e->lock);
+          continue;
+        }
+
+      if (e->in_use)
+        {
+          hash_delete (&cache_map, &e->hash_elem);
+          e->in_use = false;
+          if (e->dirty)
+            {
+              hash_insert (&evict_map, &e->hash_elem);
+              lock_release (&cache_lock);
+              write_back (e);
+              lock_acquire (&cache_lock);
+              hash_delete (&evict_map, &e->hash_elem);
+            }
+        }
+      return e;
+    }
+  return NULL;
+}
+
+/* Returns true if SECTOR is cached or being written back by
+   cache_evict().  Caller must hold cache_lock. */
+static bool
+is_cached (block_sector_t sector)
+{
+  return (map_lookup (&cache_map, sector) != NULL
+          || map_lookup (&evict_map, sector) != NULL);
+}
+
+/* Makes entry E, which cache_evict() just returned, hold SECTOR.
+   Its contents are left for the caller to fill.  Caller must hold
+   cache_lock. */
+static void
+install (struct cache_entry *e, block_sector_t sector)
+{
+  miss_cnt++;
+  e->sector = sector;
+  e->in_use = true;
+  e->dirty = false;
+  e->accessed = true;
+  e->journaled = false;
+  hash_insert (&cache_map, &e->hash_elem);
+}
+
+/* Reads SECTOR from disk into DATA and checks it against its
+   checksum.  A mismatch may come from a transient read error, so
+   the sector is read once more before concluding that it is
+   corrupt, which panics the kernel rather than handing bad data to
+   the file system. */
+static void
+load_sector (block_sector_t sector, void *data)
+{
+  block_read (fs_device, sector, data);
+  if (!checksum_verify (sector, data))
+    {
+      block_read (fs_device, sector, data);
+      if (!checksum_verify (sector, data))
+        PANIC ("filesys: sector %"PRDSNu" is corrupt", sector);
+    }
+}
+
+/* Returns the entry for SECTOR with its lock held, bringing the
+   sector into the cache if necessary.  If LOAD is false and the
+   sector is not already cached, its contents are left
+   uninitialized, so the caller must overwrite the whole sector. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+
+      lock_acquire (&cache_lock);
+      e = map_lookup (&cache_map, sector);
+      if (e != NULL)
+        {
+          e->accessed = true;
+          hit_cnt++;
+          lock_release (&cache_lock);
+
+          /* The entry may have been evicted while we waited. */
+          lock_acquire (&e->lock);
+          if (e->in_use && e->sector == sector)
+            return e;
+          lock_release (&e->lock);
+          continue;
+        }
+
+      e = map_lookup (&evict_map, sector);
+      if (e != NULL)
+        {
+          /* Wait for the write-back to finish, then look again. */
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          lock_release (&e->lock);
+          continue;
+        }
+
+      e = cache_evict ();
+      if (e == NULL)
+        {
+          lock_release (&cache_lock);
+          thread_yield ();
+          continue;
+        }
+      if (is_cached (sector))
+        {
+          /* Another thread brought SECTOR in while the victim was
+             being written back. */
+          lock_release (&e->lock);
+          lock_release (&cache_lock);
+          continue;
+        }
+      install (e, sector);
+      lock_release (&cache_lock);
+
+      if (load)
+        load_sector (sector, e->data);
+      return e;
+    }
+}
+
+/* Returns a new entry for SECTOR with its lock held and its
+   contents uninitialized, for the caller to read SECTOR into.
+   Returns a null pointer if SECTOR is already cached or every
+   entry is busy.  Unlike cache_get(), never waits for another
+   entry's lock. */
+static struct cache_entry *
+cache_claim (block_sector_t sector)
+{
+  struct cache_entry *e = NULL;
+
+  lock_acquire (&cache_lock);
+  if (!is_cached (sector))
+    {
+      e = cache_evict ();
+      if (e != NULL)
+        {
+          if (!is_cached (sector))
+            install (e, sector);
+          else
+            {
+              lock_release (&e->lock);
+              e = NULL;
+            }
+        }
+    }
+  lock_release (&cache_lock);
+  return e;
+}
+
+/* Marks entry E, whose lock the caller must hold, as dirty. */
+static void
+mark_dirty (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (!e->dirty)
+    {
+      e->dirty = true;
+      lock_acquire (&dirty_lock);
+      dirty_cnt++;
+      lock_release (&dirty_lock);
+    }
+}
+
+/* Writes entry E, whose lock the caller must hold, back to disk
+   if it is dirty. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (e->dirty)
+    {
+      checksum_update (e->sector, e->data);
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+      lock_acquire (&dirty_lock);
+      dirty_cnt--;
+      lock_release (&dirty_lock);
+    }
+}
+
+/* Returns a hash value for the sector held by cache entry E. */
+static unsigned
+cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *c = hash_entry (e, struct cache_entry, hash_elem);
+  return hash_int (c->sector);
+}
+
+/* Returns true if cache entry A holds a lower sector than B. */
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct cache_entry *a = hash_entry (a_, struct cache_entry, hash_elem);
+  const struct cache_entry *b = hash_entry (b_, struct cache_entry, hash_elem);
+  return a->sector < b->sector;
+}
@@ -0,0 +1,32 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Default number of sectors held by the buffer cache. */
+#define CACHE_DEFAULT_SECTORS 64
+
+/* Fewest sectors the buffer cache may hold.  The journal holds
+   back up to a quarter of the cache, and needs room for at least
+   two sectors. */
+#define CACHE_MIN_SECTORS 8
+
+void cache_configure (size_t sectors);
+void cache_configure_high_water (size_t sectors);
+void cache_init (void);
+void cache_flush (void);
+
+void cache_read (block_sector_t, void *);
+void cache_write (block_sector_t, const void *);
+void cache_read_at (block_sector_t, void *, size_t ofs, size_t size);
+void cache_write_at (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_write_journaled (block_sector_t, const void *,
+                            size_t ofs, size_t size);
+void cache_release_journaled (block_sector_t);
+void cache_prefetch (block_sector_t);
+size_t cache_size (void);
+
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
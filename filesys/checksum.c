@@ -0,0 +1,334 @@
+#include "filesys/checksum.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Per-sector checksums.
+
+   A file system formatted with checksums keeps a CRC32C of every
+   sector in a table at the end of the device, followed by a header
+   in the very last sector.  The table is held in memory.  A
+   sector's checksum is updated whenever the buffer cache writes it
+   to disk and verified whenever the buffer cache reads it from
+   disk, but not again while it stays cached.  The buffer cache
+   panics on a sector that still fails after being read again.  A
+   checksum of 0 means that none is recorded, as for a sector that
+   has not been written since the file system was formatted.
+
+   The free map file records whether the file system was formatted
+   with checksums, so that a header left behind by an earlier
+   format is never mistaken for a live one.
+
+   Like the free map, the table on disk lags behind while the file
+   system is mounted, so after an unclean shutdown the recorded
+   checksums are recomputed from the sectors on disk.  The journal
+   and the table itself are written directly to the device, not
+   through the buffer cache, and have no checksums. */
+
+/* Header, in the device's last sector. */
+struct checksum_header
+  {
+    uint32_t magic;                     /* CHECKSUM_MAGIC. */
+    uint32_t state;                     /* CHECKSUM_CLEAN or _ACTIVE. */
+    uint32_t sector_cnt;                /* Sectors covered by the table. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12];
+  };
+
+#define CHECKSUM_MAGIC 0x4d555343       /* "CSUM" */
+#define CHECKSUM_CLEAN 0x4e454c43       /* "CLEN" */
+#define CHECKSUM_ACTIVE 0x56544341      /* "ACTV" */
+
+/* Number of checksums in a table sector. */
+#define SECTOR_CHECKSUMS (BLOCK_SECTOR_SIZE / sizeof (uint32_t))
+
+/* True if the file system device has checksums. */
+static bool active;
+
+static uint32_t *table;              /* One checksum per sector. */
+static size_t sector_cnt;            /* Number of entries in TABLE. */
+static size_t table_sectors;         /* Sectors that hold TABLE. */
+static block_sector_t table_start;   /* First sector of TABLE on disk. */
+static struct bitmap *dirty_map;     /* Table sectors changed since
+                                        they were last written. */
+static struct lock checksum_lock;    /* Protects all of the above. */
+
+/* Lookup tables for computing CRC32C eight bytes at a time
+   ("slicing-by-8").  crc_table[0] is the usual byte-at-a-time
+   table. */
+static uint32_t crc_table[8][256];
+
+/* Reversed CRC32C (Castagnoli) polynomial. */
+#define CRC32C_POLY 0x82f63b78
+
+static void write_header (uint32_t state);
+static void write_table (void);
+static void rebuild (void);
+
+/* Returns the CRC32C of the SIZE bytes in BUFFER, continuing from
+   CRC, the CRC of the bytes before them (0 for none). */
+uint32_t
+crc32c (uint32_t crc, const void *buffer, size_t size)
+{
+  const uint8_t *p = buffer;
+
+  crc = ~crc;
+  for (; size > 0 && (uintptr_t) p % 4 != 0; size--)
+    crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  for (; size >= 8; size -= 8, p += 8)
+    {
+      uint32_t lo = *(const uint32_t *) p ^ crc;
+      uint32_t hi = *(const uint32_t *) (p + 4);
+      crc = (crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff]
+             ^ crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24]
+             ^ crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff]
+             ^ crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24]);
+    }
+  for (; size > 0; size--)
+    crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+/* Returns the checksum to record for SECTOR's contents DATA, which
+   is never 0. */
+static uint32_t
+sector_checksum (const void *data)
+{
+  uint32_t crc = crc32c (0, data, BLOCK_SECTOR_SIZE);
+  return crc != 0 ? crc : 1;
+}
+
+/* Initializes the checksum module. */
+void
+checksum_init (void)
+{
+  size_t i, j;
+
+  ASSERT (sizeof (struct checksum_header) == BLOCK_SECTOR_SIZE);
+
+  for (i = 0; i < 256; i++)
+    {
+      uint32_t crc = i;
+      for (j = 0; j < 8; j++)
+        crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+      crc_table[0][i] = crc;
+    }
+  for (i = 0; i < 256; i++)
+    for (j = 1; j < 8; j++)
+      crc_table[j][i] = ((crc_table[j - 1][i] >> 8)
+                         ^ crc_table[0][crc_table[j - 1][i] & 0xff]);
+  lock_init (&checksum_lock);
+}
+
+/* Sets up the table's geometry for the file system device and
+   allocates it, all zeros. */
+static void
+allocate_table (void)
+{
+  sector_cnt = block_size (fs_device);
+  table_sectors = DIV_ROUND_UP (sector_cnt, SECTOR_CHECKSUMS);
+  table_start = sector_cnt - 1 - table_sectors;
+  table = calloc (table_sectors, BLOCK_SECTOR_SIZE);
+  dirty_map = bitmap_create (table_sectors);
+  if (table == NULL || dirty_map == NULL)
+    PANIC ("checksum table allocation failed--file system device "
+           "is too large");
+}
+
+/* Reserves room for checksums on a newly formatted file system.
+   Must be called before anything else is written. */
+void
+checksum_create (void)
+{
+  allocate_table ();
+  free_map_mark (table_start, table_sectors + 1);
+  bitmap_set_all (dirty_map, true);
+  write_table ();
+  write_header (CHECKSUM_ACTIVE);
+  active = true;
+}
+
+/* Overwrites the header that an earlier format with checksums may
+   have left in the device's last sector, on a file system being
+   formatted without them. */
+void
+checksum_erase (void)
+{
+  struct checksum_header *h = calloc (1, sizeof *h);
+
+  if (h == NULL)
+    PANIC ("can't allocate checksum header");
+  block_write (fs_device, block_size (fs_device) - 1, h);
+  free (h);
+}
+
+/* Looks for checksums on the file system device and reads them
+   into memory, rebuilding them from the disk if the file system
+   was not shut down cleanly.  Must be called before anything reads
+   the file system through the buffer cache.  Returns true if there
+   are checksums. */
+bool
+checksum_open (void)
+{
+  struct checksum_header *h = malloc (sizeof *h);
+  size_t i;
+
+  if (h == NULL)
+    PANIC ("can't allocate checksum header");
+  block_read (fs_device, block_size (fs_device) - 1, h);
+  if ((free_map_features () & FREE_MAP_CHECKSUMS)
+      && h->magic == CHECKSUM_MAGIC
+      && h->sector_cnt == block_size (fs_device))
+    {
+      allocate_table ();
+      for (i = 0; i < table_sectors; i++)
+        block_read (fs_device, table_start + i,
+                    (uint8_t *) table + i * BLOCK_SECTOR_SIZE);
+      if (h->state != CHECKSUM_CLEAN)
+        rebuild ();
+      write_header (CHECKSUM_ACTIVE);
+      active = true;
+    }
+  free (h);
+  return active;
+}
+
+/* Marks the checksum table, if there is one, as in use in the free
+   map, for rebuilding the free map after a crash. */
+void
+checksum_mark_used (void)
+{
+  if (active)
+    free_map_mark (table_start, table_sectors + 1);
+}
+
+/* Writes the parts of the checksum table that have changed since
+   they were last written. */
+void
+checksum_sync (void)
+{
+  if (!active)
+    return;
+  lock_acquire (&checksum_lock);
+  write_table ();
+  lock_release (&checksum_lock);
+}
+
+/* Writes the checksum table and marks it up to date.  Everything
+   else must already be on disk. */
+void
+checksum_close (void)
+{
+  if (!active)
+    return;
+  lock_acquire (&checksum_lock);
+  write_table ();
+  write_header (CHECKSUM_CLEAN);
+  lock_release (&checksum_lock);
+}
+
+/* Records DATA as the contents of SECTOR, which is about to be
+   written to disk. */
+void
+checksum_update (block_sector_t sector, const void *data)
+{
+  uint32_t crc;
+
+  if (!active)
+    return;
+  crc = sector_checksum (data);
+  ASSERT (sector < sector_cnt);
+  lock_acquire (&checksum_lock);
+  if (table[sector] != crc)
+    {
+      table[sector] = crc;
+      bitmap_mark (dirty_map, sector / SECTOR_CHECKSUMS);
+    }
+  lock_release (&checksum_lock);
+}
+
+/* Checks DATA, just read from SECTOR, against SECTOR's checksum
+   and reports a mismatch on the console.  Returns false if there
+   is a mismatch. */
+bool
+checksum_verify (block_sector_t sector, const void *data)
+{
+  uint32_t expected, crc;
+
+  if (!active)
+    return true;
+  ASSERT (sector < sector_cnt);
+  expected = table[sector];
+  if (expected == 0)
+    return true;
+  crc = sector_checksum (data);
+  if (crc == expected)
+    return true;
+  printf ("filesys: sector %"PRDSNu" fails checksum "
+          "(expected %08"PRIx32", found %08"PRIx32")\n",
+          sector, expected, crc);
+  return false;
+}
+
+/* Writes the header with the given STATE. */
+static void
+write_header (uint32_t state)
+{
+  struct checksum_header *h = calloc (1, sizeof *h);
+
+  if (h == NULL)
+    PANIC ("can't allocate checksum header");
+  h->magic = CHECKSUM_MAGIC;
+  h->state = state;
+  h->sector_cnt = sector_cnt;
+  block_write (fs_device, sector_cnt - 1, h);
+  free (h);
+}
+
+/* Writes the table sectors that dirty_map marks.  Caller must hold
+   checksum_lock, unless the file system is being formatted or
+   opened. */
+static void
+write_table (void)
+{
+  size_t i;
+
+  for (i = bitmap_scan (dirty_map, 0, 1, true); i != BITMAP_ERROR;
+       i = bitmap_scan (dirty_map, i + 1, 1, true))
+    {
+      block_write (fs_device, table_start + i,
+                   (uint8_t *) table + i * BLOCK_SECTOR_SIZE);
+      bitmap_reset (dirty_map, i);
+    }
+}
+
+/* Recomputes every recorded checksum from what is on disk, after
+   an unclean shutdown left the table behind.  Sectors whose
+   checksum did not reach the disk stay unrecorded until they are
+   written again. */
+static void
+rebuild (void)
+{
+  uint8_t *buffer = malloc (BLOCK_SECTOR_SIZE);
+  block_sector_t sector;
+
+  if (buffer == NULL)
+    PANIC ("can't allocate checksum buffer");
+  printf ("Rebuilding checksums...");
+  for (sector = 0; sector < table_start; sector++)
+    if (table[sector] != 0)
+      {
+        block_read (fs_device, sector, buffer);
+        table[sector] = sector_checksum (buffer);
+      }
+  bitmap_set_all (dirty_map, true);
+  write_table ();
+  free (buffer);
+  printf ("done.\n");
+}
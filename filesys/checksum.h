@@ -0,0 +1,22 @@
+#ifndef FILESYS_CHECKSUM_H
+#define FILESYS_CHECKSUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+uint32_t crc32c (uint32_t crc, const void *, size_t);
+
+void checksum_init (void);
+void checksum_create (void);
+void checksum_erase (void);
+bool checksum_open (void);
+void checksum_mark_used (void);
+void checksum_sync (void);
+void checksum_close (void);
+
+void checksum_update (block_sector_t, const void *);
+bool checksum_verify (block_sector_t, const void *);
+
+#endif /* filesys/checksum.h */
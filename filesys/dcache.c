@@ -0,0 +1,225 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The directory entry cache remembers the results of recent
+   directory lookups, so that resolving a path whose components
+   were resolved recently needs no directory reads.  Each entry
+   maps a name in the directory whose inode is in sector DIR to
+   the sector of the named file's inode, or to DCACHE_ABSENT if
+   the directory is known to have no such name.
+
+   dir_add() and dir_remove() invalidate the entries for the names
+   they change.  A lookup that missed in the cache reads the
+   directory and then inserts what it found, but another thread
+   may change the directory in between; each invalidation bumps a
+   generation number, and an insert is dropped if the generation
+   changed since its lookup began. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentry_map. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory inode sector. */
+    char name[NAME_MAX + 1];            /* Name within DIR. */
+    block_sector_t sector;              /* Inode sector or DCACHE_ABSENT. */
+  };
+
+/* Array of DCACHE_ENTRIES entries. */
+static struct dentry *dentries;
+
+/* Maps a directory and name to its entry. */
+static struct hash dentry_map;
+
+/* Entries in DENTRY_MAP, least recently used first, followed by
+   the unused entries. */
+static struct list lru_list;
+
+/* Number of entries in DENTRY_MAP. */
+static size_t dentry_cnt;
+
+/* Bumped on every invalidation. */
+static unsigned generation;
+
+/* Protects all of the above. */
+static struct lock dcache_lock;
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  dentries = calloc (DCACHE_ENTRIES, sizeof *dentries);
+  if (dentries == NULL || !hash_init (&dentry_map, dentry_hash, dentry_less,
+                                      NULL))
+    PANIC ("can't allocate directory entry cache");
+  list_init (&lru_list);
+  for (i = 0; i < DCACHE_ENTRIES; i++)
+    list_push_back (&lru_list, &dentries[i].lru_elem);
+  lock_init (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there
+   is none.  The caller must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  static struct dentry key;
+  struct hash_elem *e;
+
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_map, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache and makes it the next entry to be
+   reused.  The caller must hold dcache_lock. */
+static void
+discard (struct dentry *d)
+{
+  hash_delete (&dentry_map, &d->hash_elem);
+  dentry_cnt--;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows the answer, returns true and sets *SECTOR to
+   the named inode's sector, or to DCACHE_ABSENT if the name does
+   not exist.  Otherwise, returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      *sector = d->sector;
+      list_remove (&d->lru_elem);
+      list_push_back (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Returns the current generation, to be passed to a later call to
+   dcache_insert(). */
+unsigned
+dcache_generation (void)
+{
+  unsigned g;
+
+  lock_acquire (&dcache_lock);
+  g = generation;
+  lock_release (&dcache_lock);
+  return g;
+}
+
+/* Records that NAME in the directory whose inode is in sector DIR
+   has its inode in SECTOR, or does not exist if SECTOR is
+   DCACHE_ABSENT.  Does nothing if anything has been invalidated
+   since dcache_generation() returned GEN. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector,
+               unsigned gen)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  if (gen == generation)
+    {
+      d = find (dir, name);
+      if (d != NULL)
+        discard (d);
+
+      /* Reuse the front entry, which is unused unless the cache
+         is full, in which case it is the least recently used. */
+      d = list_entry (list_pop_front (&lru_list), struct dentry, lru_elem);
+      if (dentry_cnt == DCACHE_ENTRIES)
+        {
+          hash_delete (&dentry_map, &d->hash_elem);
+          dentry_cnt--;
+        }
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      d->sector = sector;
+      hash_insert (&dentry_map, &d->hash_elem);
+      dentry_cnt++;
+      list_push_back (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything known about NAME in the directory whose inode
+   is in sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  generation++;
+  if (strlen (name) <= NAME_MAX)
+    {
+      d = find (dir, name);
+      if (d != NULL)
+        discard (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets everything known about the directory whose inode is in
+   sector DIR, which is about to hold a new directory. */
+void
+dcache_invalidate_dir (block_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  generation++;
+  for (i = 0; i < DCACHE_ENTRIES; i++)
+    {
+      struct dentry *d = &dentries[i];
+      if (d->dir == dir && find (d->dir, d->name) == d)
+        discard (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns a hash value for dentry D. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,23 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Sector reported by dcache_lookup() for a name that is known not
+   to exist. */
+#define DCACHE_ABSENT ((block_sector_t) -1)
+
+/* Number of names held by the directory entry cache. */
+#define DCACHE_ENTRIES 256
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t dir, const char *name,
+                    block_sector_t *sector);
+unsigned dcache_generation (void);
+void dcache_insert (block_sector_t dir, const char *name,
+                    block_sector_t sector, unsigned generation);
+void dcache_invalidate (block_sector_t dir, const char *name);
+void dcache_invalidate_dir (block_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -2,24 +2,26 @@
 #define DIR_TOKENIZER_H
 
 #include <stdbool.h>
-
-void dirtok_init(char const* path);
-bool dirtok_next(char* buf);
-bool dirtok_hasnext();
+#include <stddef.h>
 
 /*
-  * Get full pathname of the directory immediately before the specified new file/directory.
-  * For example, if we want to create a new file or directory at path "/a/b/c", this function would return "/a/b"
+  * Cursor over the components of a path.  It points into the caller's copy of
+  * the path, which must stay unchanged while the cursor is in use, so any
+  * number of paths can be tokenized at once without allocating memory.
   */
-void dirtok_get_abspath_updir(char const* pathname, char* buf);
+struct dirtok {
+    const char* pos;    /* Next character to examine. */
+    const char* end;    /* End of the path. */
+};
 
-/* Get full pathname of the directory/file. */
-void dirtok_get_abspath(char const* pathname, char* buf);
+void dirtok_init(struct dirtok* tok, char const* path, size_t len);
+size_t dirtok_next(struct dirtok* tok, char* buf);
 
-/* Get the filename of the directory/file. For example, given the path "/a/b/c", this function would return "c" */
-void dirtok_get_filename(char const* pathname, char* buf);
+/* Get the last component of a path. For example, given the path "/a/b/c", this function would return "c" */
+char const* dirtok_last(char const* pathname);
 
-void dirtok_test();
+/* Get full pathname of the directory/file. */
+bool dirtok_get_abspath(char const* pathname, char* buf);
 
 
 #endif
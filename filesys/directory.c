@@ -1,14 +1,250 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "filesys/dir-tokenizer.h"
+#include "threads/thread.h"
 #include "threads/malloc.h"
 
 /* A directory. */
 
+/* Directories come in two formats.  A flat directory is an array
+   of `struct dir_entry' that lookups scan from the start.  Once a
+   flat directory would grow past DIR_FLAT_MAX entries, it is
+   rebuilt as a hashed directory: a header sector followed by
+   buckets, each a sector of DIR_BUCKET_ENTRIES slots, which hold
+   the entries in an open-addressed hash table with linear probing.
+   A lookup then reads about one sector however large the
+   directory is.
+
+   In a hashed directory, a slot whose entry is not in use is
+   empty if its name is empty, and otherwise is a tombstone left by
+   dir_remove(), which a probe must step over. */
+#define DIR_FLAT_MAX 50                 /* Largest flat directory. */
+#define DIR_MIN_BUCKETS 4               /* Buckets in a new hashed dir. */
+#define DIR_BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+#define DIR_HASH_MAGIC "HASHDIR"
+
+/* Start of the first sector of a hashed directory.  A flat
+   directory can never start this way, because the first bytes of
+   its first entry are a sector number, and no disk is that big. */
+struct dir_header
+  {
+    char magic[8];                      /* DIR_HASH_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t used_cnt;                  /* Slots in use or tombstones. */
+  };
+
+/* A bucket of a hashed directory. */
+struct dir_bucket
+  {
+    struct dir_entry entries[DIR_BUCKET_ENTRIES];
+    uint8_t unused[BLOCK_SECTOR_SIZE
+                   - DIR_BUCKET_ENTRIES * sizeof (struct dir_entry)];
+  };
+
+/* Reads DIR's header into *H.  Returns true if DIR is hashed,
+   false if it is flat. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && !memcmp (h->magic, DIR_HASH_MAGIC, sizeof h->magic));
+}
+
+/* Returns the byte offset of slot SLOT in a hashed directory. */
+static off_t
+slot_ofs (size_t slot)
+{
+  return ((1 + slot / DIR_BUCKET_ENTRIES) * BLOCK_SECTOR_SIZE
+          + slot % DIR_BUCKET_ENTRIES * sizeof (struct dir_entry));
+}
+
+/* Reads the entry at or after *POS in DIR into *E, whether in use
+   or not, and advances *POS past it.  H is DIR's header if DIR is
+   hashed, or a null pointer if it is flat.  Returns false at the
+   end of the directory. */
+static bool
+read_entry (const struct dir *dir, const struct dir_header *h, off_t *pos,
+            struct dir_entry *e)
+{
+  if (h != NULL)
+    {
+      /* Skip the header and the unused end of each bucket. */
+      if (*pos < BLOCK_SECTOR_SIZE
+          || (size_t) (*pos % BLOCK_SECTOR_SIZE)
+             > (DIR_BUCKET_ENTRIES - 1) * sizeof *e)
+        *pos = ROUND_UP (*pos + 1, BLOCK_SECTOR_SIZE);
+      if (*pos >= (off_t) ((1 + h->bucket_cnt) * BLOCK_SECTOR_SIZE))
+        return false;
+    }
+  if (inode_read_at (dir->inode, e, sizeof *e, *pos) != sizeof *e)
+    return false;
+  *pos += sizeof *e;
+  return true;
+}
+
+/* Probes hashed directory DIR, whose header is H, for NAME.  If it
+   is found, returns true, sets *EP to its entry if EP is non-null,
+   and sets *OFSP to the entry's byte offset if OFSP is non-null.
+   Otherwise, returns false, and if FREEP is non-null, sets *FREEP
+   to the offset of the first empty slot or tombstone that NAME
+   could be added in, or to -1 if there is none, and *EMPTYP to
+   whether that slot is empty. */
+static bool
+hash_probe (const struct dir *dir, const struct dir_header *h,
+            const char *name, struct dir_entry *ep, off_t *ofsp,
+            off_t *freep, bool *emptyp)
+{
+  size_t slot_cnt = h->bucket_cnt * DIR_BUCKET_ENTRIES;
+  size_t slot = hash_string (name) % slot_cnt;
+  size_t loaded = SIZE_MAX;
+  struct dir_bucket *b;
+  bool found = false;
+  size_t i;
+
+  if (freep != NULL)
+    *freep = -1;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  for (i = 0; i < slot_cnt; i++, slot = (slot + 1) % slot_cnt)
+    {
+      size_t bucket = slot / DIR_BUCKET_ENTRIES;
+      struct dir_entry *e = &b->entries[slot % DIR_BUCKET_ENTRIES];
+
+      if (bucket != loaded)
+        {
+          off_t ofs = (1 + bucket) * BLOCK_SECTOR_SIZE;
+          if (inode_read_at (dir->inode, b, sizeof *b, ofs) != sizeof *b)
+            break;
+          loaded = bucket;
+        }
+
+      if (e->in_use)
+        {
+          if (!strcmp (e->name, name))
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = slot_ofs (slot);
+              found = true;
+              break;
+            }
+        }
+      else
+        {
+          if (freep != NULL && *freep == -1)
+            {
+              *freep = slot_ofs (slot);
+              *emptyp = e->name[0] == '\0';
+            }
+
+          /* An empty slot ends the probe sequence. */
+          if (e->name[0] == '\0')
+            break;
+        }
+    }
+  free (b);
+  return found;
+}
+
+/* Adds an entry for NAME and INODE_SECTOR to hashed directory DIR,
+   whose header is *H, which must not already contain NAME.
+   Updates *H.  Returns true if successful. */
+static bool
+hash_add (struct dir *dir, struct dir_header *h, const char *name,
+          block_sector_t inode_sector)
+{
+  struct dir_entry e;
+  off_t ofs;
+  bool empty;
+
+  if (hash_probe (dir, h, name, NULL, NULL, &ofs, &empty) || ofs == -1)
+    return false;
+
+  memset (&e, 0, sizeof e);
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+    return false;
+  if (empty)
+    {
+      h->used_cnt++;
+      inode_write_at (dir->inode, h, sizeof *h, 0);
+    }
+  return true;
+}
+
+/* Rebuilds DIR, which is flat if H is a null pointer and otherwise
+   hashed with header *H, as a hashed directory with at least
+   BUCKET_CNT buckets, dropping tombstones.  The new table is built
+   in memory before any of DIR is overwritten.  Returns true if
+   successful.  On failure, DIR's entries are unchanged. */
+static bool
+dir_rebuild (struct dir *dir, const struct dir_header *h, size_t bucket_cnt)
+{
+  struct dir_header *new;
+  struct dir_bucket *buckets;
+  struct dir_entry e;
+  size_t cnt = 0, slot_cnt, i;
+  uint8_t *table;
+  off_t pos;
+
+  /* Count the entries in use. */
+  for (pos = 0; read_entry (dir, h, &pos, &e); )
+    if (e.in_use)
+      cnt++;
+
+  /* Keep the table at most 3/4 full, counting the entry that is
+     about to be added. */
+  while ((cnt + 1) * 4 > bucket_cnt * DIR_BUCKET_ENTRIES * 3)
+    bucket_cnt *= 2;
+  slot_cnt = bucket_cnt * DIR_BUCKET_ENTRIES;
+
+  /* Build the header sector and buckets in memory. */
+  table = calloc (bucket_cnt + 1, BLOCK_SECTOR_SIZE);
+  if (table == NULL)
+    return false;
+  new = (struct dir_header *) table;
+  buckets = (struct dir_bucket *) (table + BLOCK_SECTOR_SIZE);
+  memcpy (new->magic, DIR_HASH_MAGIC, sizeof new->magic);
+  new->bucket_cnt = bucket_cnt;
+  new->used_cnt = 0;
+  for (pos = 0; new->used_cnt < cnt && read_entry (dir, h, &pos, &e); )
+    if (e.in_use)
+      {
+        size_t slot = hash_string (e.name) % slot_cnt;
+
+        while (buckets[slot / DIR_BUCKET_ENTRIES]
+               .entries[slot % DIR_BUCKET_ENTRIES].in_use)
+          slot = (slot + 1) % slot_cnt;
+        buckets[slot / DIR_BUCKET_ENTRIES]
+          .entries[slot % DIR_BUCKET_ENTRIES] = e;
+        new->used_cnt++;
+      }
+
+  /* Allocate all of the sectors before overwriting any. */
+  if (!inode_reserve (dir->inode, (bucket_cnt + 1) * BLOCK_SECTOR_SIZE))
+    {
+      free (table);
+      return false;
+    }
+  for (i = 0; i <= bucket_cnt; i++)
+    inode_write_at (dir->inode, table + i * BLOCK_SECTOR_SIZE,
+                    BLOCK_SECTOR_SIZE, i * BLOCK_SECTOR_SIZE);
+  free (table);
+  return true;
+}
+
 
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
@@ -17,6 +253,8 @@ dir_create (block_sector_t sector, size_t entry_cnt)
 {
 
   struct dir_entry dire_entry;
+  dcache_invalidate_dir (sector);
+  memset (&dire_entry, 0, sizeof dire_entry);
   dire_entry.inode_sector = sector;
   if(!inode_create (sector, entry_cnt * sizeof (struct dir_entry), true)) //IDK if true goes here
   {
@@ -65,35 +303,62 @@ dir_open_root (void)
   return dir_open (inode_open (ROOT_DIR_SECTOR));
 }
 
-/*
-  * Open a directory given its full absolute path.
-  * Returns nullptr on failure.
-  */
-struct dir*
-dir_open_path(char const* pathname) {
-  struct dir* cur_dir = dir_open_root();
-  struct inode* cur_inode;
-  // char* dirname = (char*)malloc(sizeof(char) * (DIRNAME_MAX + 1));
-  char dirname[NAME_MAX + 1];
-  dirtok_init(pathname);
-  while (dirtok_next(dirname)) {
-    // printf("Opening next directory: %s\n", dirname);
-    if (dir_lookup(cur_dir, dirname, &cur_inode)) {
-      // printf("Directory successfully opened: %s\n", dirname);
-      cur_dir = dir_open(cur_inode);
-      if (!cur_dir) {
-        // printf("directory (dir_open_path): failed to open directory %s\n", dirname);
-        inode_close(cur_inode);
-        return NULL;
-      }
-    }
-    else {
-      // printf("directory (dir_open_path): dir does not exist.\n");
-      inode_close(cur_inode);
-      return NULL;
+/* Follows the LEN characters of PATH from DIR, which is closed,
+   and returns the directory reached, or a null pointer if a
+   component does not exist. */
+static struct dir *
+walk_path (struct dir *dir, const char *path, size_t len)
+{
+  char name[NAME_MAX + 1];
+  struct dirtok tok;
+  size_t name_len;
+
+  dirtok_init (&tok, path, len);
+  while (dir != NULL && (name_len = dirtok_next (&tok, name)) != 0)
+    {
+      struct inode *inode = NULL;
+
+      if (name_len <= NAME_MAX)
+        dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      dir = dir_open (inode);
     }
-  }
-  return cur_dir;
+  return dir;
+}
+
+/* Opens the directory that relative PATH starts from: the root
+   directory if PATH is absolute, otherwise the current
+   directory. */
+static struct dir *
+open_start (const char *path)
+{
+  if (*path == '/' || thread_current ()->cur_dir == NULL)
+    return dir_open_root ();
+  return dir_open_path (thread_current ()->cur_dir);
+}
+
+/* Opens the directory named by PATH, which may be relative or
+   absolute.  Returns a null pointer on failure. */
+struct dir *
+dir_open_path (const char *path)
+{
+  return walk_path (open_start (path), path, strlen (path));
+}
+
+/* Opens the directory that contains the last component of PATH,
+   which may be relative or absolute, and copies that component,
+   which is empty if PATH ends in `/', into NAME.  Returns a null
+   pointer on failure, including when the last component is
+   longer than NAME_MAX. */
+struct dir *
+dir_open_parent (const char *path, char name[NAME_MAX + 1])
+{
+  const char *last = dirtok_last (path);
+
+  if (strlen (last) > NAME_MAX)
+    return NULL;
+  strlcpy (name, last, NAME_MAX + 1);
+  return walk_path (open_start (path), path, last - path);
 }
 
 /* Opens and returns a new directory for the same inode as DIR.
@@ -131,12 +396,16 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    return hash_probe (dir, &h, name, ep, ofsp, NULL, NULL);
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -158,13 +427,25 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  dir_sector = inode_get_inumber (dir->inode);
+
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      unsigned gen = dcache_generation ();
+      rwlock_acquire_read (&dir->inode->dir_lock);
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_ABSENT;
+      rwlock_release_read (&dir->inode->dir_lock);
+      dcache_insert (dir_sector, name, sector, gen);
+    }
+
+  if (sector != DCACHE_ABSENT)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
@@ -181,6 +462,7 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   // printf("adding dir %s\n", name);
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -199,11 +481,25 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   //   printf("%s\n", name);
   // }
 
+  rwlock_acquire_write (&dir->inode->dir_lock);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL)) {
     // printf("file/dir already exists\n");
     goto done;
   }
+
+  /* A hashed directory is rebuilt with more buckets once it is 3/4
+     full, counting tombstones. */
+  if (read_header (dir, &h))
+    {
+      if ((h.used_cnt + 1) * 4 > h.bucket_cnt * DIR_BUCKET_ENTRIES * 3
+          && !dir_rebuild (dir, &h, h.bucket_cnt * 2))
+        goto done;
+      read_header (dir, &h);
+      success = hash_add (dir, &h, name, inode_sector);
+      goto done;
+    }
     
 
   /* Set OFS to offset of free slot.
@@ -218,6 +514,14 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
     if (!e.in_use)
       break;
 
+  /* A flat directory that would grow too big becomes hashed. */
+  if (ofs / sizeof e >= DIR_FLAT_MAX)
+    {
+      if (dir_rebuild (dir, NULL, DIR_MIN_BUCKETS) && read_header (dir, &h))
+        success = hash_add (dir, &h, name, inode_sector);
+      goto done;
+    }
+
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
@@ -225,6 +529,9 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  if (success)
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
+  rwlock_release_write (&dir->inode->dir_lock);
   return success;
 }
 
@@ -242,6 +549,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  rwlock_acquire_write (&dir->inode->dir_lock);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -255,16 +564,19 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  rwlock_release_write (&dir->inode->dir_lock);
+
   /* Check if dir is not empty */
   dir = dir_open(inode);
   char buf[NAME_MAX + 1];
-  if (dir_readdir(dir, buf)) {
+  if (dir != NULL && dir_readdir(dir, buf)) {
     // printf("Found %s in dir\n", buf);
     return false;
   }
@@ -278,11 +590,14 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
+  bool hashed, found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  rwlock_acquire_read (&dir->inode->dir_lock);
+  hashed = read_header (dir, &h);
+  while (read_entry (dir, hashed ? &h : NULL, &dir->pos, &e))
     {
-      dir->pos += sizeof e;
       if (e.in_use)
         {
           if (strcmp(e.name, ".") == 0 || strcmp(e.name, "..") == 0) {
@@ -290,8 +605,10 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
           }
           strlcpy (name, e.name, NAME_MAX + 1);
           // printf("directory (readdir): next dir is %s\n", name);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  rwlock_release_read (&dir->inode->dir_lock);
+  return found;
 }
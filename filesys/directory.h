@@ -37,7 +37,8 @@ struct dir_entry
 bool dir_create (block_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
-struct dir* dir_open_path(char const* pathname);
+struct dir *dir_open_path (const char *path);
+struct dir *dir_open_parent (const char *path, char name[NAME_MAX + 1]);
 struct dir *dir_reopen (struct dir *);
 void dir_close (struct dir *);
 struct inode *dir_get_inode (struct dir *);
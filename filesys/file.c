@@ -1,6 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -15,6 +16,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      inode_readahead_init (&file->ra);
       return file;
     }
   else
@@ -56,11 +58,13 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   Sequential reads prefetch the data that follows them. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  inode_read_ahead (file->inode, &file->ra, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -89,7 +93,9 @@ file_write (struct file *file, const void *buffer, off_t size)
   if (inode_is_dir(file->inode)) {
     thread_exit(-1);
   }
+  journal_begin ();
   off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  journal_end ();
   file->pos += bytes_written;
   return bytes_written;
 }
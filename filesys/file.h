@@ -11,6 +11,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    struct inode_readahead ra;  /* Sequential read detection. */
   };
 
 /* Opening and closing files. */
@@ -2,17 +2,36 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/checksum.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
-#include "filesys/dir-tokenizer.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
 #include "threads/thread.h"
 
+/* Number of timer ticks between passes of the write-behind
+   thread over the buffer cache. */
+#define WRITE_BEHIND_TICKS (TIMER_FREQ / 2)
+
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Inode layout that do_format() gives the new file system. */
+static enum inode_layout format_layout = INODE_LAYOUT_POINTERS;
+
+/* Whether do_format() gives the new file system a journal and
+   per-sector checksums. */
+static bool format_journal = true;
+static bool format_checksums = false;
+
 static void do_format (void);
+static void recover_free_map (void);
+static thread_func write_behind NO_RETURN;
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -23,13 +42,80 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  dcache_init ();
   free_map_init ();
+  journal_init ();
+  checksum_init ();
 
   if (format) 
     do_format ();
+  else
+    {
+      /* Finish any committed transaction before reading anything
+         else. */
+      journal_open ();
+      checksum_open ();
+
+      /* New inodes follow the layout chosen at format time, which
+         the root directory's magic number records. */
+      struct inode *root = inode_open (ROOT_DIR_SECTOR);
+      if (root == NULL)
+        PANIC ("can't open root directory");
+      inode_set_layout (inode_get_layout (root));
+      inode_close (root);
+    }
+
+  if (!free_map_open ())
+    recover_free_map ();
 
-  free_map_open ();
+  if (thread_create ("write-behind", PRI_DEFAULT, write_behind, NULL)
+      == TID_ERROR)
+    PANIC ("can't start write-behind thread");
+}
+
+/* Parses OPTIONS, a comma-separated list of options for
+   formatting the file system, which may be:
+
+     extents  Map file data with extents instead of pointers.
+     pointers Map file data with direct and indirect pointers.
+     journal  Journal metadata updates (the default).
+     nojournal  Do not journal metadata updates.
+     crc      Keep a CRC32C of every sector and verify it on reads.
+
+   Returns false if OPTIONS contains anything else.  Modifies
+   OPTIONS. */
+bool
+filesys_set_format_options (char *options)
+{
+  char *opt, *save_ptr;
+
+  for (opt = strtok_r (options, ",", &save_ptr); opt != NULL;
+       opt = strtok_r (NULL, ",", &save_ptr))
+    if (!strcmp (opt, "extents"))
+      format_layout = INODE_LAYOUT_EXTENTS;
+    else if (!strcmp (opt, "pointers"))
+      format_layout = INODE_LAYOUT_POINTERS;
+    else if (!strcmp (opt, "journal"))
+      format_journal = true;
+    else if (!strcmp (opt, "nojournal"))
+      format_journal = false;
+    else if (!strcmp (opt, "crc"))
+      format_checksums = true;
+    else
+      return false;
+  return true;
+}
+
+/* Writes all of the file system's unwritten data to disk. */
+void
+filesys_sync (void)
+{
+  free_map_sync ();
+  journal_commit ();
+  cache_flush ();
+  checksum_sync ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -37,7 +123,10 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  journal_commit ();
   free_map_close ();
+  cache_flush ();
+  checksum_close ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -47,61 +136,27 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size, bool is_dir) 
 {
-  // printf("create\n");
-  dirtok_init(name);
-  char* name_check = (char*)malloc(sizeof(char) * (DIRNAME_MAX + 1));
-  // char name_check[DIRNAME_MAX];
-  while (dirtok_next(name_check)) {
-    if (strlen(name_check) > NAME_MAX) {
-      free(name_check);
-      return false;
-    }
-  }
-  free(name_check);
-
-  char* path = (char*)malloc(sizeof(char) * (DIRNAME_MAX + 1));
-  char* filename = (char*)malloc(sizeof(char) * (NAME_MAX + 1));
-  if (!path || !filename) {
-    printf("malloc error\n");
-  }
-
-  // char path[DIRNAME_MAX + 1];
-  // char filename[NAME_MAX + 1];
-
-  // printf("filesys (filesys_create): creating file/dir %s\n", name);
+  char filename[NAME_MAX + 1];
   block_sector_t inode_sector = 0;
-  /* Check if name is absolute or relative */
-  dirtok_get_abspath_updir(name, path);
-  struct dir* dir = dir_open_path(path);
-  if (!dir) {
-    free(path);
-    free(filename);
-    return false;
-  }
-
-  /* Check if filename is too big */
-  dirtok_get_filename(name, filename);
-  if (strlen(filename) > NAME_MAX) {
-    free(path);
-    free(filename);
-    return false;
-  }
-
+  struct dir *dir;
   bool success;
+
+  journal_begin ();
+  dir = dir_open_parent (name, filename);
   if (is_dir) {
-    // printf("making dir %s in %s\n", filename, path);
     success = dir != NULL
                         && free_map_allocate(1, &inode_sector)
                         && dir_create(inode_sector, 0)
                         && dir_add(dir, filename, inode_sector);
     /* Add the "." and ".." hard links */
-    block_sector_t parent_inode_sector = dir->inode->sector;
-    dirtok_get_abspath(name, path);
-    dir = dir_open_path(path);
-    success = success
-                        && dir_add(dir, ".", inode_sector)
-                        && dir_add(dir, "..", parent_inode_sector);
-    int t;
+    if (success) {
+      struct dir *new_dir = dir_open (inode_open (inode_sector));
+      success = new_dir != NULL
+                        && dir_add(new_dir, ".", inode_sector)
+                        && dir_add(new_dir, "..",
+                                   inode_get_inumber (dir_get_inode (dir)));
+      dir_close (new_dir);
+    }
   }
   else {
     success = dir != NULL
@@ -111,19 +166,9 @@ filesys_create (const char *name, off_t initial_size, bool is_dir)
   }
   
   if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+    journal_release (inode_sector, 1);
   dir_close (dir);
-
-  if (success) {
-    if (is_dir) {
-      // printf("filesys (filesys_create) - successfully created dir %s\n", path);
-    }
-    else {
-      // printf("filesys (filesys_create) - successfully created file %s%s\n", path, filename);
-    }
-  }
-  free(path);
-  free(filename);
+  journal_end ();
   return success;
 }
 
@@ -135,85 +180,25 @@ filesys_create (const char *name, off_t initial_size, bool is_dir)
 struct file *
 filesys_open (const char *name)
 {
-  if (*name == '/' && *(name + 1) == '\0') {  // if root, just return the root inode
-    struct dir* dir = dir_open_root();
-    return file_open(dir->inode);
-  }
-  //printf("\n\n\n@@@HERE\n\n\n");
-  char* path = (char*)malloc(sizeof(char) * (DIRNAME_MAX + 1));
-  char* filename = (char*)malloc(sizeof(char) * (NAME_MAX + 1));
-  if (!path || !filename) {
-    printf("malloc error\n");
-  }
-
-  // char path[DIRNAME_MAX + 1];
-  // char filename[NAME_MAX + 1];
-
-  dirtok_get_abspath_updir(name, path);
-  // printf("opening file/dir %s\n", path);
-  struct dir *dir = dir_open_path(path);
-  struct inode *inode = NULL;
-  
-  dirtok_get_filename(name, filename);
-
-  bool success;
-  if (dir != NULL) {
-    success = dir_lookup (dir, filename, &inode);
-  }
-
-  // printf("Dir lookup succeeded in open: %d\n", success);
-  dir_close (dir);
-
-  free(path);
-  free(filename);
-  return file_open (inode);
+  return file_open (filesys_open_inode (name));
 }
 
+/* Opens the inode of the file or directory with the given NAME.
+   Returns the inode if successful or a null pointer otherwise. */
 struct inode*
 filesys_open_inode(char const* name) {
-  // printf("open\n");
   if (*name == '/' && *(name + 1) == '\0') {  // if root, just return the root inode
-    struct dir* dir = dir_open_root();
-    return dir->inode;
-  }
-
-  char* path = (char*)malloc(sizeof(char) * (DIRNAME_MAX + 1));
-  char* filename = (char*)malloc(sizeof(char) * (NAME_MAX + 1));
-  if (!path || !filename) {
-    printf("malloc error\n");
-  }
-
-  // char path[DIRNAME_MAX + 1];
-  // char filename[NAME_MAX + 1];
-
-  dirtok_get_abspath_updir(name, path);
-  // printf("path is %s\n", path);
-  struct dir* dir = dir_open_path(path);
-  // printf("path is now %s\n", path);
-  if (!dir) {
-    // printf("filesys (filesys_open_inode): parent dir does not exist.\n");
-    free(path);
-    free(filename);
-    return NULL;
+    return inode_open (ROOT_DIR_SECTOR);
   }
 
+  char filename[NAME_MAX + 1];
+  struct dir* dir = dir_open_parent(name, filename);
   struct inode* inode = NULL;
-  
-  dirtok_get_filename(name, filename);
-  // printf("the path is %s\n", path - 1);
-
-  if (!dir_lookup(dir, filename, &inode)) {
-    // printf("filesys (filesys_open_inode): failed to find the file: %s in the directory %s\n", filename, path);
-    dir_close(dir);
-    free(filename);
-    free(path);
-    return NULL;
-  }
 
-  // printf("filesys (filesys_open_inode): opening file/dir %s from dir %s\n", filename, path);
+  if (dir != NULL) {
+    dir_lookup(dir, filename, &inode);
+  }
   dir_close(dir);
-  free(filename);
-  free(path);
   return inode;
 }
 
@@ -224,53 +209,122 @@ filesys_open_inode(char const* name) {
 bool
 filesys_remove (const char *name) 
 {
-  // printf("remove\n");
-  char* path = (char*)malloc(sizeof(char) * (DIRNAME_MAX + 1));
-  char* filename = (char*)malloc(sizeof(char) * (NAME_MAX + 1));
-  if (!path || !filename) {
-    printf("malloc error\n");
-  }
-
-  // char path[DIRNAME_MAX + 1];
-  // char filename[NAME_MAX + 1];
+  char filename[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
 
-  dirtok_get_abspath(name, path);
-  if (*path == '/' && *(path + 1) == '\0') { // can't remove root directory'
-    // printf("can't remove root\n'");
-    free(path);
-    free(filename);
-    return false;
-  }
-  dirtok_get_abspath_updir(name, path);
-  // printf("filesys (filesys_remove): file/dir's parent dir is %s\n", path);
-  struct dir* dir = dir_open_path(path);
- 
-  if (!dir) {
-    // printf("filesys (filesys_remove): dir does not exist.\n");
-    free(path);
-    free(filename);
-    return false;
-  }
-  
-  dirtok_get_filename(name, filename);
-  // printf("Removing %s from %s\n", filename, path);
+  journal_begin ();
+  dir = dir_open_parent (name, filename);
 
-  bool success = dir != NULL && dir_remove (dir, filename);
+  /* The root directory has no parent entry, and the last
+     component of "/" is empty. */
+  success = dir != NULL && *filename != '\0' && dir_remove (dir, filename);
   dir_close (dir); 
-  free(path);
-  free(filename);
-  // printf("done removing\n");
+  journal_end ();
   return success;
 }
-
+
+/* Write-behind thread.  Periodically writes the free map and
+   dirty sectors in the buffer cache back to disk, so that writers
+   need not wait for the disk themselves. */
+static void
+write_behind (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_TICKS);
+      filesys_sync ();
+    }
+}
+
+/* Marks the sectors of every file and directory in the tree
+   rooted at directory ROOT, whose own inode must already be
+   marked, as in use in the free map.  Directories still to be
+   scanned are kept in a heap-allocated worklist rather than on
+   the kernel stack, which is far too small to recurse through a
+   deep tree.  A directory whose inode is already marked has been
+   visited, so a damaged tree cannot make this loop forever. */
+static void
+mark_tree (block_sector_t root)
+{
+  block_sector_t *work = NULL;
+  size_t work_cnt = 0, work_max = 0;
+
+  for (;;)
+    {
+      char name[NAME_MAX + 1];
+      struct inode *inode;
+      struct dir *dir;
+
+      dir = dir_open (inode_open (root));
+      if (dir != NULL)
+        {
+          while (dir_readdir (dir, name))
+            if (dir_lookup (dir, name, &inode))
+              {
+                if (inode_mark_used (inode) && inode_is_dir (inode))
+                  {
+                    if (work_cnt == work_max)
+                      {
+                        work_max = work_max * 2 + 16;
+                        work = realloc (work, work_max * sizeof *work);
+                        if (work == NULL)
+                          PANIC ("out of memory recovering free map");
+                      }
+                    work[work_cnt++] = inode_get_inumber (inode);
+                  }
+                inode_close (inode);
+              }
+          dir_close (dir);
+        }
+
+      if (work_cnt == 0)
+        break;
+      root = work[--work_cnt];
+    }
+  free (work);
+}
+
+/* Rebuilds the free map after an unclean shutdown, during which
+   the free map on disk may have fallen behind the sectors actually
+   in use.  Every sector reachable from the root directory is in
+   use; all others are free.  This also reclaims the sectors of
+   files that were removed while still open. */
+static void
+recover_free_map (void)
+{
+  struct dir *root;
+
+  printf ("Recovering free map...");
+  free_map_reset ();
+  journal_mark_used ();
+  checksum_mark_used ();
+  root = dir_open_root ();
+  if (root == NULL)
+    PANIC ("can't open root directory");
+  inode_mark_used (dir_get_inode (root));
+  dir_close (root);
+  mark_tree (ROOT_DIR_SECTOR);
+  filesys_sync ();
+  printf ("done.\n");
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
-  free_map_create ();
+  inode_set_layout (format_layout);
+  if (format_journal)
+    journal_create ();
+  if (format_checksums)
+    checksum_create ();
+  else
+    checksum_erase ();
+  free_map_create (format_checksums ? FREE_MAP_CHECKSUMS : 0);
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
+  journal_commit ();
   free_map_close ();
   printf ("done.\n");
 }
@@ -12,6 +12,8 @@
 struct block *fs_device;
 
 void filesys_init (bool format);
+bool filesys_set_format_options (char *options);
+void filesys_sync (void);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size, bool is_dir);
 struct file *filesys_open (const char *name);
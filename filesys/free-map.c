@@ -1,85 +1,454 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The free map is summarized in groups of this many sectors, so
+   that searches can skip over full or fragmented regions of the
+   disk without looking at their bits. */
+#define GROUP_SECTORS 256
+
+/* The free map file holds the bitmap followed by a word that says
+   whether the file system was shut down cleanly.  While the file
+   system is mounted the word is FREE_MAP_ACTIVE, because changes
+   to the bitmap reach the disk only at sync points; a free map
+   found in that state after a crash must be rebuilt.  A second
+   word holds the FREE_MAP_* feature flags chosen at format time. */
+#define FREE_MAP_CLEAN 0x4e454c43       /* "CLEN" */
+#define FREE_MAP_ACTIVE 0x56544341      /* "ACTV" */
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *dirty_map;     /* Free map file sectors changed
+                                        since they were last written. */
+static struct lock free_map_lock;    /* Protects all of the above. */
+
+/* Per-group summary of the free map. */
+static size_t group_cnt;             /* Number of groups. */
+static uint16_t *group_run;          /* Longest free run in each group. */
+
+/* Next-fit cursor: the sector just past the last allocation made
+   without a goal.  Searches start here instead of at sector 0. */
+static block_sector_t cursor;
+
+/* Returns the number of free sectors starting at SECTOR, counting
+   no further than MAX_CNT. */
+static size_t
+free_run_at (block_sector_t sector, size_t max_cnt)
+{
+  size_t bits = bitmap_size (free_map);
+  size_t cnt = 0;
+
+  while (cnt < max_cnt && sector + cnt < bits
+         && !bitmap_test (free_map, sector + cnt))
+    cnt++;
+  return cnt;
+}
+
+/* Recomputes the summary of GROUP from the free map. */
+static void
+update_group (size_t group)
+{
+  size_t start = group * GROUP_SECTORS;
+  size_t end = start + GROUP_SECTORS;
+  size_t run = 0, longest = 0;
+  size_t i;
+
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+  for (i = start; i < end; i++)
+    if (!bitmap_test (free_map, i))
+      {
+        if (++run > longest)
+          longest = run;
+      }
+    else
+      run = 0;
+  group_run[group] = longest;
+}
+
+/* Recomputes the summaries of the groups that hold the CNT sectors
+   starting at SECTOR. */
+static void
+update_groups (block_sector_t sector, size_t cnt)
+{
+  size_t group;
+
+  for (group = sector / GROUP_SECTORS;
+       group <= (sector + cnt - 1) / GROUP_SECTORS; group++)
+    update_group (group);
+}
+
+/* Returns the first sector of the first free run in GROUP that is
+   at least WANT sectors long, or of the longest run if there is
+   none that long. */
+static block_sector_t
+group_find (size_t group, size_t want)
+{
+  size_t start = group * GROUP_SECTORS;
+  size_t end = start + GROUP_SECTORS;
+  size_t run = 0, longest = 0;
+  block_sector_t best = start;
+  size_t i;
+
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+  for (i = start; i < end; i++)
+    if (!bitmap_test (free_map, i))
+      {
+        if (++run > longest)
+          {
+            longest = run;
+            best = i + 1 - run;
+            if (longest >= want)
+              break;
+          }
+      }
+    else
+      run = 0;
+  return best;
+}
+
+/* Finds a free run of at least MIN_CNT and at most MAX_CNT
+   sectors, preferring one that starts at GOAL, then the first one
+   at or after the cursor that is long enough to satisfy MAX_CNT
+   (up to a group's worth), then the longest one available.
+   Stores its first sector in *SECTORP and returns its length, or
+   returns 0 if there is no such run.  Does not mark the run as
+   allocated. */
+static size_t
+find_run (block_sector_t goal, size_t min_cnt, size_t max_cnt,
+          block_sector_t *sectorp)
+{
+  size_t want = max_cnt < GROUP_SECTORS ? max_cnt : GROUP_SECTORS;
+  size_t first = cursor / GROUP_SECTORS;
+  size_t best = SIZE_MAX;
+  size_t i, cnt;
+
+  /* Extend the run that the goal continues, if possible. */
+  if (goal != 0 && goal < bitmap_size (free_map))
+    {
+      cnt = free_run_at (goal, max_cnt);
+      if (cnt >= min_cnt)
+        {
+          *sectorp = goal;
+          return cnt;
+        }
+    }
+
+  /* Next fit, by group, remembering the group with the longest
+     run in case none is long enough. */
+  if (min_cnt <= GROUP_SECTORS)
+    for (i = 0; i < group_cnt; i++)
+      {
+        size_t group = (first + i) % group_cnt;
+
+        if (group_run[group] >= want)
+          {
+            best = group;
+            break;
+          }
+        if (group_run[group] >= min_cnt
+            && (best == SIZE_MAX || group_run[group] > group_run[best]))
+          best = group;
+      }
+  if (best != SIZE_MAX)
+    {
+      *sectorp = group_find (best, want);
+      return free_run_at (*sectorp, max_cnt);
+    }
+
+  /* A run longer than a group, or one that only exists across a
+     group boundary, needs a full scan. */
+  if (min_cnt > 1)
+    {
+      block_sector_t sector = bitmap_scan (free_map, 0, min_cnt, false);
+      if (sector != BITMAP_ERROR)
+        {
+          *sectorp = sector;
+          return free_run_at (sector, max_cnt);
+        }
+    }
+  return 0;
+}
+
+/* Records that the CNT bits starting at SECTOR have changed: the
+   free map file sectors that hold them must be written back, and
+   the summaries of their groups are out of date. */
+static void
+mark_changed (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / 8 / BLOCK_SECTOR_SIZE;
+  size_t last = (sector + cnt - 1) / 8 / BLOCK_SECTOR_SIZE;
+
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+  update_groups (sector, cnt);
+}
+
+/* Writes STATE into the free map file's state word.  Returns true
+   if successful. */
+static bool
+write_state (uint32_t state)
+{
+  return (file_write_at (free_map_file, &state, sizeof state,
+                         bitmap_file_size (free_map))
+          == sizeof state);
+}
+
+/* Returns the offset of the feature word in the free map file. */
+static off_t
+features_ofs (void)
+{
+  return bitmap_file_size (free_map) + sizeof (uint32_t);
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  size_t group;
+
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                           BLOCK_SECTOR_SIZE));
+  if (dirty_map == NULL)
+    PANIC ("free map dirty bitmap allocation failed");
+  lock_init (&free_map_lock);
+
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_run = malloc (group_cnt * sizeof *group_run);
+  if (group_run == NULL)
+    PANIC ("free map summary allocation failed");
+  for (group = 0; group < group_cnt; group++)
+    update_group (group);
+}
+
+/* Allocates a run of up to MAX_CNT consecutive sectors from the
+   free map and stores the first into *SECTORP.  The run starts at
+   GOAL if that sector is free, so that a file growing from GOAL
+   stays contiguous; a GOAL of 0 means no preference.  Returns the
+   number of sectors allocated, which is 0 if the disk is full. */
+size_t
+free_map_allocate_run (block_sector_t goal, size_t max_cnt,
+                       block_sector_t *sectorp)
+{
+  block_sector_t sector;
+  size_t cnt;
+
+  ASSERT (max_cnt > 0);
+  lock_acquire (&free_map_lock);
+  cnt = find_run (goal, 1, max_cnt, &sector);
+  if (cnt > 0)
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_changed (sector, cnt);
+      if (goal == 0 || sector != goal)
+        cursor = sector + cnt;
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
+  return cnt;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = find_run (0, cnt, cnt, &sector) == cnt;
+  if (success)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_changed (sector, cnt);
+      cursor = sector + cnt;
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  lock_release (&free_map_lock);
+  return success;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_changed (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that have changed since
+   they were last written.  The writes go to the buffer cache, so
+   a cache_flush() must follow for them to reach the disk. */
+void
+free_map_sync (void)
+{
+  size_t size, i;
+
+  lock_acquire (&free_map_lock);
+  if (free_map_file != NULL)
+    {
+      size = bitmap_file_size (free_map);
+      for (i = bitmap_scan (dirty_map, 0, 1, true); i != BITMAP_ERROR;
+           i = bitmap_scan (dirty_map, i + 1, 1, true))
+        {
+          size_t ofs = i * BLOCK_SECTOR_SIZE;
+          size_t part = (size - ofs < BLOCK_SECTOR_SIZE
+                         ? size - ofs : BLOCK_SECTOR_SIZE);
+
+          if (bitmap_write_part (free_map, free_map_file, ofs, part))
+            bitmap_reset (dirty_map, i);
+        }
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Marks CNT sectors starting at SECTOR as in use.  For rebuilding
+   the free map after free_map_reset(). */
+void
+free_map_mark (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  mark_changed (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Returns true if SECTOR is in use. */
+bool
+free_map_is_used (block_sector_t sector)
+{
+  bool used;
+
+  lock_acquire (&free_map_lock);
+  used = bitmap_test (free_map, sector);
+  lock_release (&free_map_lock);
+  return used;
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Begins rebuilding the free map after an unclean shutdown, by
+   marking every sector free except those of the free map file
+   itself.  The caller must then mark every other sector in use
+   with free_map_mark() and write the result with
+   free_map_sync(). */
 void
+free_map_reset (void)
+{
+  size_t group;
+
+  lock_acquire (&free_map_lock);
+  bitmap_set_all (free_map, false);
+  bitmap_set_all (dirty_map, true);
+  for (group = 0; group < group_cnt; group++)
+    update_group (group);
+  cursor = 0;
+  lock_release (&free_map_lock);
+
+  inode_mark_used (file_get_inode (free_map_file));
+}
+
+/* Opens the free map file and reads it from disk.  Returns true if
+   the file system was shut down cleanly, false if the free map may
+   be out of date and must be rebuilt. */
+bool
 free_map_open (void) 
 {
+  uint32_t state;
+  bool clean;
+  size_t group;
+
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  for (group = 0; group < group_cnt; group++)
+    update_group (group);
+
+  /* A free map without a state word predates it and may be stale
+     too. */
+  clean = (file_read_at (free_map_file, &state, sizeof state,
+                         bitmap_file_size (free_map)) == sizeof state
+           && state == FREE_MAP_CLEAN);
+
+  /* From here on the bitmap on disk lags behind.  Make sure that a
+     crash leaves evidence of that. */
+  if (!write_state (FREE_MAP_ACTIVE))
+    PANIC ("can't write free map");
+  cache_flush ();
+  return clean;
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Writes the free map to disk, marks it clean, and closes the free
+   map file. */
 void
 free_map_close (void) 
 {
+  /* Everything else must be on disk before the state word says
+     that the free map is up to date. */
+  free_map_sync ();
+  cache_flush ();
+  write_state (FREE_MAP_CLEAN);
+
+  lock_acquire (&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
-/* Creates a new free map file on disk and writes the free map to
-   it. */
+/* Creates a new free map file on disk, recording the FREE_MAP_*
+   flags in FEATURES, and writes the free map to it. */
 void
-free_map_create (void) 
+free_map_create (uint32_t features) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
+  if (!inode_create (FREE_MAP_SECTOR,
+                     features_ofs () + sizeof features, false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, free_map_file)
+      || !write_state (FREE_MAP_ACTIVE)
+      || (file_write_at (free_map_file, &features, sizeof features,
+                         features_ofs ()) != sizeof features))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
+}
+
+/* Returns the FREE_MAP_* flags recorded when the file system was
+   formatted, or 0 if there are none.  Reads them straight from the
+   free map file, so it may be called before free_map_open(). */
+uint32_t
+free_map_features (void)
+{
+  struct file *file = file_open (inode_open (FREE_MAP_SECTOR));
+  uint32_t features = 0;
+
+  if (file != NULL
+      && (file_read_at (file, &features, sizeof features, features_ofs ())
+          != sizeof features))
+    features = 0;
+  file_close (file);
+  return features;
 }
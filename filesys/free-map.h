@@ -3,15 +3,27 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "devices/block.h"
 
+/* Feature flags recorded in the free map file at format time. */
+#define FREE_MAP_CHECKSUMS 0x1          /* Per-sector checksums. */
+
 void free_map_init (void);
 void free_map_read (void);
-void free_map_create (void);
-void free_map_open (void);
+void free_map_create (uint32_t features);
+uint32_t free_map_features (void);
+bool free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+size_t free_map_allocate_run (block_sector_t goal, size_t max_cnt,
+                              block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_sync (void);
+
+void free_map_reset (void);
+void free_map_mark (block_sector_t, size_t);
+bool free_map_is_used (block_sector_t);
 
 #endif /* filesys/free-map.h */
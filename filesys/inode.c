@@ -4,14 +4,39 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 
-struct indirect_block_sec{
-  block_sector_t direct[INDIRECT_BLOCKS];
-};
+/* Bounds on the number of sectors read ahead of a sequential
+   reader. */
+#define READ_AHEAD_MIN 2
+#define READ_AHEAD_MAX 16
+
+/* Number of data sectors reachable through the indirect block and
+   through the doubly indirect block. */
+#define INDIRECT_SECTORS INDIRECT_BLOCKS
+#define DOUBLY_INDIRECT_SECTORS (INDIRECT_BLOCKS * INDIRECT_BLOCKS)
+
+/* Largest number of data sectors an inode can map. */
+#define MAX_FILE_SECTORS \
+  (DIRECT_BLOCKS + INDIRECT_SECTORS + DOUBLY_INDIRECT_SECTORS)
+
+/* Number of sectors inode_read_at() and inode_write_at() map with
+   each call to inode_map_range(). */
+#define MAP_BATCH 16
+
+/* Number of closed inodes kept in memory in case they are opened
+   again.  0 disables the cache. */
+#define CLOSED_INODES 32
+
+/* A sector's worth of zeros, for initializing new sectors. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -20,180 +45,638 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/*allocates space in the inode stuff */
-bool inode_alloc(struct inode_disk *disk_inode, off_t length){
-  static char null_stuff[BLOCK_SECTOR_SIZE];
+/* Returns INODE's in-memory copy of index block SECTOR, which is
+   kept in *COPYP, reading it from the buffer cache if there is no
+   copy yet.  If FRESH is true, SECTOR was just allocated, so the
+   copy starts out as all zeros instead.  Returns a null pointer
+   if memory is short. */
+static block_sector_t *
+load_index (block_sector_t sector, block_sector_t **copyp, bool fresh)
+{
+  if (*copyp == NULL)
+    {
+      *copyp = malloc (BLOCK_SECTOR_SIZE);
+      if (*copyp == NULL)
+        return NULL;
+      if (fresh)
+        memset (*copyp, 0, BLOCK_SECTOR_SIZE);
+      else
+        cache_read (sector, *copyp);
+    }
+  return *copyp;
+}
 
+/* Discards INODE's in-memory copies of its index blocks.  They are
+   reloaded on demand. */
+static void
+drop_index_copies (struct inode *inode)
+{
+  free (inode->indirect_copy);
+  free (inode->doubly_copy);
+  free (inode->leaf_copy);
+  inode->indirect_copy = inode->doubly_copy = inode->leaf_copy = NULL;
+}
 
-  if (length < 0){
+/* If *SECTORP is 0, stores ASSIGN into it, or if ASSIGN is 0,
+   allocates a zeroed sector into it.  Sets *FRESH to whether a
+   sector was allocated.  Returns false if the disk is full. */
+static bool
+alloc_sector (block_sector_t *sectorp, block_sector_t assign, bool *fresh)
+{
+  *fresh = false;
+  if (*sectorp != 0)
+    return true;
+  if (assign != 0)
+    {
+      *sectorp = assign;
+      return true;
+    }
+  if (!free_map_allocate (1, sectorp))
     return false;
-  }
-  off_t sectors = bytes_to_sectors(length);
-  if(sectors <= DIRECT_BLOCKS){
-     //printf("\n\n@@@@\n\n");
-    for(int k = 0; k < sectors; k+=1){
-    //  printf("\n\nSTART\n\n\n");
-     //  printf("\n\n\%d\n\n", disk_inode->direct[k]);
-      if(disk_inode->direct[k] == 0){
-        if(!free_map_allocate(1, &disk_inode->direct[k])){
-          return false;
+  journal_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  *fresh = true;
+  return true;
+}
+
+/* Makes sure that slot IDX of index block SECTOR, whose in-memory
+   copy is TABLE, points to a sector, filling it as alloc_sector()
+   would with ASSIGN if ALLOCATE is true.  Keeps TABLE and the
+   buffer cache's copy of SECTOR in step.  Returns the sector, or 0
+   if none is allocated or allocation failed.  Sets *FRESH as
+   alloc_sector() does. */
+static block_sector_t
+index_slot (block_sector_t sector, block_sector_t *table, size_t idx,
+            bool allocate, block_sector_t assign, bool *fresh)
+{
+  *fresh = false;
+  if (table[idx] == 0 && allocate)
+    {
+      if (!alloc_sector (&table[idx], assign, fresh))
+        return 0;
+      journal_write (sector, &table[idx], idx * sizeof *table,
+                     sizeof *table);
+    }
+  return table[idx];
+}
+
+/* Returns the sector that holds data sector IDX of INODE, which
+   must use the pointer layout, or 0 if there is none.  If ALLOCATE
+   is true, allocates the data sector and any index blocks needed
+   to reach it, and returns 0 only if the disk is full or memory is
+   short; the caller must then write INODE's on-disk inode back.
+   If ASSIGN is nonzero, a missing data sector is set to ASSIGN
+   instead of being newly allocated.
+
+   The index blocks are read through copies kept in INODE, so
+   mapping consecutive sectors costs no extra buffer cache
+   lookups. */
+static block_sector_t
+index_to_sector (struct inode *inode, size_t idx, bool allocate,
+                 block_sector_t assign)
+{
+  struct inode_disk *d = &inode->data;
+  block_sector_t *table;
+  bool fresh;
+
+  if (idx < DIRECT_BLOCKS)
+    {
+      if (allocate && !alloc_sector (&d->direct[idx], assign, &fresh))
+        return 0;
+      return d->direct[idx];
+    }
+  idx -= DIRECT_BLOCKS;
+
+  if (idx < INDIRECT_SECTORS)
+    {
+      if (allocate && !alloc_sector (&d->indirect, 0, &fresh))
+        return 0;
+      if (d->indirect == 0)
+        return 0;
+      table = load_index (d->indirect, &inode->indirect_copy, fresh);
+      if (table == NULL)
+        return 0;
+      return index_slot (d->indirect, table, idx, allocate, assign, &fresh);
+    }
+  idx -= INDIRECT_SECTORS;
+
+  if (idx < DOUBLY_INDIRECT_SECTORS)
+    {
+      size_t outer = idx / INDIRECT_BLOCKS;
+      block_sector_t leaf;
+
+      if (allocate && !alloc_sector (&d->doubly_indirect, 0, &fresh))
+        return 0;
+      if (d->doubly_indirect == 0)
+        return 0;
+      table = load_index (d->doubly_indirect, &inode->doubly_copy, fresh);
+      if (table == NULL)
+        return 0;
+      leaf = index_slot (d->doubly_indirect, table, outer, allocate, 0,
+                         &fresh);
+      if (leaf == 0)
+        return 0;
+
+      /* Only one second-level block is kept in memory at a time. */
+      if (inode->leaf_copy != NULL && inode->leaf_idx != outer)
+        {
+          free (inode->leaf_copy);
+          inode->leaf_copy = NULL;
         }
-       block_write(fs_device, disk_inode->direct[k], null_stuff);
-      }
-      //printf("\n\n\nEND\n\n\n");
+      inode->leaf_idx = outer;
+      table = load_index (leaf, &inode->leaf_copy, fresh);
+      if (table == NULL)
+        return 0;
+      return index_slot (leaf, table, idx % INDIRECT_BLOCKS, allocate,
+                         assign, &fresh);
     }
-    //printf("\n\n\nTRUE\n\n\n");
-    return true;
-  }
-  else{
-    for(int k = 0; k < DIRECT_BLOCKS; k+=1){
-      if(disk_inode->direct[k] == 0){
-        if(!free_map_allocate(1, &disk_inode->direct[k])){
-          return false;
+
+  return 0;
+}
+
+/* Returns true if on-disk inode D keeps its data inline. */
+static inline bool
+uses_inline (const struct inode_disk *d)
+{
+  return d->is_inline;
+}
+
+/* Returns true if on-disk inode D uses the extent layout. */
+static inline bool
+uses_extents (const struct inode_disk *d)
+{
+  return d->magic == INODE_EXTENT_MAGIC;
+}
+
+/* Returns the number of data sectors mapped by extent-layout
+   inode D. */
+static size_t
+extent_sectors (const struct inode_disk *d)
+{
+  size_t sectors = 0;
+  size_t i;
+
+  for (i = 0; i < d->extent_cnt; i++)
+    sectors += d->extents[i].length;
+  return sectors;
+}
+
+/* Stores into SECTORS, which has room for MAX entries, the
+   sectors that hold data sectors FIRST through LAST of
+   extent-layout inode D.  Returns the number of entries stored.
+   Finding FIRST takes one step per extent before it; each sector
+   after that takes constant time. */
+static size_t
+extent_map (const struct inode_disk *d, size_t first, size_t last,
+            block_sector_t sectors[], size_t max)
+{
+  size_t base = 0;
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < d->extent_cnt; i++)
+    {
+      const struct inode_extent *e = &d->extents[i];
+
+      while (cnt < max && first + cnt <= last
+             && first + cnt - base < e->length)
+        {
+          sectors[cnt] = e->start + (first + cnt - base);
+          cnt++;
         }
-        block_write(fs_device, disk_inode->direct[k], null_stuff);
-      }
+      if (cnt == max || first + cnt > last)
+        break;
+      base += e->length;
     }
-    sectors-=DIRECT_BLOCKS;
-    off_t num_alloc;
-    if(sectors <= INDIRECT_BLOCKS){
-      num_alloc = sectors;
+  return cnt;
+}
+
+/* Allocates the data sectors of pointer-layout INODE that hold
+   the SIZE bytes starting at OFFSET and are still holes.  Data
+   sectors are allocated in runs starting at INODE's allocation
+   goal, so that a growing file stays contiguous on disk.  A new
+   sector is zeroed, unless WRITTEN is true and the caller is about
+   to write all of it.  Sets *CHANGED to true if anything was
+   allocated. */
+static bool
+pointer_allocate (struct inode *inode, off_t offset, off_t size,
+                  bool written, bool *changed)
+{
+  size_t idx, end;
+
+  if (size == 0)
+    return true;
+  end = bytes_to_sectors (offset + size);
+  for (idx = offset / BLOCK_SECTOR_SIZE; idx < end; idx++)
+    {
+      block_sector_t start;
+      size_t cnt, i;
+
+      if (index_to_sector (inode, idx, false, 0) != 0)
+        continue;
+
+      cnt = free_map_allocate_run (inode->alloc_goal, end - idx, &start);
+      if (cnt == 0)
+        return false;
+      *changed = true;
+      for (i = 0; i < cnt; i++)
+        {
+          off_t pos = (off_t) (idx + i) * BLOCK_SECTOR_SIZE;
+          block_sector_t sector = index_to_sector (inode, idx + i, true,
+                                                   start + i);
+          if (sector == 0)
+            {
+              journal_release (start + i, cnt - i);
+              return false;
+            }
+          else if (sector != start + i)
+            journal_release (start + i, 1);
+          else if (!written || pos < offset
+                   || pos + BLOCK_SECTOR_SIZE > offset + size)
+            cache_write (sector, zeros);
+        }
+      inode->alloc_goal = start + cnt;
+      idx += cnt - 1;
     }
-    else{
-      num_alloc = INDIRECT_BLOCKS;
+  return true;
+}
+
+/* Calls FUNC on every sector in index block SECTOR that is in
+   use, and then on SECTOR itself, one sector per call.  LEVEL is 1
+   for a block of data sector pointers, 2 for a block of pointers
+   to such blocks.  FUNC is called on data sectors only if DATA is
+   true. */
+static void
+walk_index (block_sector_t sector, int level, bool data,
+            void (*func) (block_sector_t, size_t))
+{
+  block_sector_t *table;
+  size_t i;
+
+  if (sector == 0)
+    return;
+  table = malloc (BLOCK_SECTOR_SIZE);
+  if (table != NULL)
+    {
+      cache_read (sector, table);
+      for (i = 0; i < INDIRECT_BLOCKS; i++)
+        if (table[i] != 0)
+          {
+            if (level > 1)
+              walk_index (table[i], level - 1, data, func);
+            else if (data)
+              func (table[i], 1);
+          }
+      free (table);
     }
-   
-    if(disk_inode->indirect == NULL || disk_inode->indirect == 0){
-      if(!free_map_allocate(1, &disk_inode->indirect)){
+  func (sector, 1);
+}
+
+/* Releases every sector in index block SECTOR that is in use, and
+   then SECTOR itself, as walk_index() would visit them. */
+static void
+release_index (block_sector_t sector, int level, bool data)
+{
+  walk_index (sector, level, data, journal_release);
+}
+
+/* Rewrites the sector map of extent-layout INODE in the pointer
+   layout, keeping the same data sectors.  This is the fallback for
+   a file too fragmented to fit in INODE_EXTENTS extents.  Returns
+   false, leaving INODE unchanged, if memory is short or there is
+   no room for the index blocks. */
+static bool
+extents_to_pointers (struct inode *inode)
+{
+  struct inode_disk *d = &inode->data;
+  struct inode_extent *extents;
+  size_t extent_cnt = d->extent_cnt;
+  size_t i, j, idx;
+
+  extents = malloc (sizeof d->extents);
+  if (extents == NULL)
+    return false;
+  memcpy (extents, d->extents, sizeof d->extents);
+
+  memset (d->direct, 0, sizeof d->direct);
+  d->indirect = d->doubly_indirect = 0;
+  d->magic = INODE_MAGIC;
+  drop_index_copies (inode);
+  for (i = idx = 0; i < extent_cnt; i++)
+    for (j = 0; j < extents[i].length; j++, idx++)
+      if (index_to_sector (inode, idx, true, extents[i].start + j) == 0)
+        {
+          /* Undo, releasing only the index blocks. */
+          drop_index_copies (inode);
+          release_index (d->indirect, 1, false);
+          release_index (d->doubly_indirect, 2, false);
+          d->magic = INODE_EXTENT_MAGIC;
+          d->extent_cnt = extent_cnt;
+          memcpy (d->extents, extents, sizeof d->extents);
+          free (extents);
+          return false;
+        }
+  free (extents);
+  return true;
+}
+
+/* Grows extent-layout INODE to map SECTORS data sectors.  Each
+   step allocates as long a run as the free map can supply, up to
+   what is still needed, preferring one that continues the last
+   extent, and merges it into the last extent if the two are
+   adjacent.  If INODE runs out of extents, it is converted to the
+   pointer layout. */
+static bool
+extent_extend (struct inode *inode, size_t sectors)
+{
+  struct inode_disk *d = &inode->data;
+  size_t have = extent_sectors (d);
+
+  while (have < sectors)
+    {
+      struct inode_extent *last = (d->extent_cnt > 0
+                                   ? &d->extents[d->extent_cnt - 1] : NULL);
+      block_sector_t goal = (last != NULL ? last->start + last->length
+                             : inode->alloc_goal);
+      block_sector_t start;
+      size_t cnt, i;
+
+      cnt = free_map_allocate_run (goal, sectors - have, &start);
+      if (cnt == 0)
         return false;
-      }
-      block_write(fs_device, disk_inode->indirect, null_stuff);
-    }
 
-    struct indirect_block_sec indirect_sector;
-    block_read(fs_device, disk_inode->indirect, &indirect_sector);
-    for(int k = 0; k <= num_alloc; k++){
-      if(indirect_sector.direct[k] == NULL || indirect_sector.direct[k] == 0){
-          if(!free_map_allocate(1, &indirect_sector.direct[k])){
-            return false;
-          } //ADD THE IF
+      if (last != NULL && last->start + last->length == start)
+        last->length += cnt;
+      else if (d->extent_cnt < INODE_EXTENTS)
+        {
+          d->extents[d->extent_cnt].start = start;
+          d->extents[d->extent_cnt].length = cnt;
+          d->extent_cnt++;
         }
-      //disk_inode->indirect_block_sec += 1; //Should we be incrementing this???
+      else
+        {
+          bool changed;
+
+          journal_release (start, cnt);
+          return (extents_to_pointers (inode)
+                  && pointer_allocate (inode, have * BLOCK_SECTOR_SIZE,
+                                       (sectors - have) * BLOCK_SECTOR_SIZE,
+                                       false, &changed));
+        }
+
+      for (i = 0; i < cnt; i++)
+        cache_write (start + i, zeros);
+      inode->alloc_goal = start + cnt;
+      have += cnt;
     }
-    block_write(fs_device, disk_inode->indirect, &indirect_sector);
-    return true;
-    // sectors -= num_alloc;
-    // if(sectors <= 0){
-    //   return true;
-    // }
-    // else{
-    //   return false;
-    // }
-  }
+  return true;
 }
-/* deallocates the space in inode stuff */
-bool inode_dealloc(struct inode *inode){
-  struct inode_disk disk_inode = inode->data;
-  off_t length = disk_inode.length;
-  size_t sectors = length/BLOCK_SECTOR_SIZE;
-  size_t num_dealloc;
-  if(sectors <= DIRECT_BLOCKS){
-    num_dealloc = sectors;
-  }
-  else{
-    num_dealloc = DIRECT_BLOCKS;
-  }
-  for (int k = 0; k < num_dealloc; k = 0){
-    if(disk_inode.direct[k] != 0){
-      free_map_release(disk_inode.direct[k],1);  
-  }
+
+/* Calls FUNC on each run of INODE's data and index sectors. */
+static void
+walk_sectors (struct inode *inode, void (*func) (block_sector_t, size_t))
+{
+  struct inode_disk *d = &inode->data;
+  size_t i;
+
+  if (uses_inline (d))
+    return;
+  if (uses_extents (d))
+    {
+      for (i = 0; i < d->extent_cnt; i++)
+        func (d->extents[i].start, d->extents[i].length);
+      return;
+    }
+
+  for (i = 0; i < DIRECT_BLOCKS; i++)
+    if (d->direct[i] != 0)
+      func (d->direct[i], 1);
+  walk_index (d->indirect, 1, true, func);
+  walk_index (d->doubly_indirect, 2, true, func);
 }
-  sectors -= num_dealloc;
-  if (sectors <= 0)
-  {
-    disk_inode.length = 0;
-    return true;    /* code */
-  }
-  else{
-    if(sectors <= INDIRECT_BLOCKS){
-      num_dealloc = sectors;
+
+/* Releases all of INODE's data and index sectors. */
+static void
+inode_release_sectors (struct inode *inode)
+{
+  drop_index_copies (inode);
+  walk_sectors (inode, journal_release);
+}
+
+/* Moves the inline data of INODE into a data sector, switching
+   INODE to the layout its magic number names.  Returns false,
+   leaving INODE unchanged, if memory is short or the disk is
+   full. */
+static bool
+inline_to_sectors (struct inode *inode)
+{
+  struct inode_disk *d = &inode->data;
+  off_t length = d->length;
+  uint8_t *data;
+  bool changed;
+
+  data = calloc (1, BLOCK_SECTOR_SIZE);
+  if (data == NULL)
+    return false;
+  memcpy (data, d->inline_data, length);
+
+  d->is_inline = false;
+  memset (d->inline_data, 0, sizeof d->inline_data);
+  if (length > 0)
+    {
+      bool ok = (uses_extents (d)
+                 ? extent_extend (inode, 1)
+                 : pointer_allocate (inode, 0, BLOCK_SECTOR_SIZE, true,
+                                     &changed));
+      if (!ok)
+        {
+          inode_release_sectors (inode);
+          memset (d->inline_data, 0, sizeof d->inline_data);
+          memcpy (d->inline_data, data, length);
+          d->is_inline = true;
+          free (data);
+          return false;
+        }
+      cache_write (uses_extents (d) ? d->extents[0].start : d->direct[0],
+                   data);
     }
-    else{
-      num_dealloc = INDIRECT_BLOCKS;
+  free (data);
+  return true;
+}
+
+/* Allocates the data sectors that INODE needs before SIZE bytes
+   can be written at OFFSET, zeroing those that WRITTEN says will
+   not be written in full.  A pointer-layout file may have holes,
+   which read as zeros, so only the sectors in the range itself are
+   allocated.  An extent-layout file maps every sector up to the
+   end of the range.  Sets *CHANGED to true if anything was
+   allocated.  Returns true if successful, false if the disk is
+   full or the range is too large.  Does not write back INODE's
+   on-disk inode. */
+static bool
+inode_allocate (struct inode *inode, off_t offset, off_t size, bool written,
+                bool *changed)
+{
+  size_t sectors = bytes_to_sectors (offset + size);
+
+  *changed = false;
+  if (offset < 0 || size < 0 || offset + size < 0
+      || sectors > MAX_FILE_SECTORS)
+    return false;
+
+  if (uses_inline (&inode->data))
+    {
+      if (offset + size <= INODE_INLINE_BYTES)
+        return true;
+      *changed = true;
+      if (!inline_to_sectors (inode))
+        return false;
     }
-    struct indirect_block_sec indirect_sector;
-    if (disk_inode.indirect != 0)
+
+  /* Without a goal, continue from the file's last data sector, or
+     start just past its inode if it has none. */
+  if (inode->alloc_goal == 0)
     {
-      block_read(fs_device, disk_inode.indirect, &indirect_sector );
-      for(int k = 0; k < num_dealloc; k += 1){
-        if(indirect_sector.direct[k] != 0){
-          free_map_release(indirect_sector.direct[k],1);
-        }
-      }
-      free_map_release(disk_inode.indirect, 1);
-      sectors -= num_dealloc;
-    } 
+      off_t end = inode->data.length;
+      block_sector_t last;
 
-  }
-  if(sectors<= 0){
-    disk_inode.length = 0;
-    return true;
-  }
-  disk_inode.length = sectors*BLOCK_SECTOR_SIZE;
-  return false;
+      if (end > 0 && inode_map_range (inode, end - 1, 1, &last, 1) == 1
+          && last != 0)
+        inode->alloc_goal = last + 1;
+      else
+        inode->alloc_goal = inode->sector + 1;
+    }
 
+  if (uses_extents (&inode->data))
+    {
+      *changed = extent_sectors (&inode->data) < sectors;
+      return extent_extend (inode, sectors);
+    }
+  else
+    return pointer_allocate (inode, offset, size, written, changed);
 }
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
-{
-  //printf("\n\n%d\n\n\n", pos);
-   ASSERT (inode != NULL);
-  // if (pos < inode->data.length)
-  //   return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  // else
-  //   return -1;
-  uint32_t block_index = pos/BLOCK_SECTOR_SIZE;
-  if(block_index<=DIRECT_BLOCKS-1){
-    return inode->data.direct[block_index];
-  }
-  else if(block_index >DIRECT_BLOCKS-1 && block_index <= INDIRECT_BLOCKS+DIRECT_BLOCKS){
-    block_index -= DIRECT_BLOCKS;
-    struct indirect_block_sec ibs;
-    block_read(fs_device, inode->data.indirect, &ibs);
-    return ibs.direct[block_index];
-  }
-  else{
-
-    struct indirect_block_sec ibs;
-    block_index -= DIRECT_BLOCKS;
-    block_index -= INDIRECT_BLOCKS;
-    block_read(fs_device, inode->data.doubly_indirect, &ibs);
-   // pos-=BLOCK_SECTOR_SIZE*(123+128*128);
-   // block_index = pos / (BLOCK_SECTOR_SIZE*128);
-    block_index /= INDIRECT_BLOCKS;
-    block_read(fs_device, ibs.direct[block_index], &ibs);
-    block_index %= INDIRECT_BLOCKS;
-    return ibs.direct[block_index];
-  }
 
+/* Marks INODE's own sector and all of its data and index sectors
+   as in use in the free map, for rebuilding the free map after a
+   crash.  Returns false, marking nothing, if INODE's sector was
+   already in use, which means that the free map already accounts
+   for INODE. */
+bool
+inode_mark_used (struct inode *inode)
+{
+  if (free_map_is_used (inode->sector))
+    return false;
+  free_map_mark (inode->sector, 1);
+  walk_sectors (inode, free_map_mark);
+  return true;
+}
+
+/* Translates the SIZE bytes of INODE starting at OFFSET into the
+   sectors that hold them, storing one sector per entry of SECTORS,
+   which has room for MAX entries.  The first entry holds the byte
+   at OFFSET.  A hole in a pointer-layout file maps to sector 0,
+   and an inode with inline data has no sectors to map.
+   Returns the number of entries stored, which is less than needed
+   for the whole range if MAX is too small or, for an extent-layout
+   file, the range runs past the allocated part of the file. */
+size_t
+inode_map_range (struct inode *inode, off_t offset, off_t size,
+                 block_sector_t sectors[], size_t max)
+{
+  size_t first, last, cnt;
+
+  ASSERT (inode != NULL);
+  ASSERT (offset >= 0);
+  if (size <= 0)
+    return 0;
+
+  if (uses_inline (&inode->data))
+    return 0;
 
-  return -1;
+  first = offset / BLOCK_SECTOR_SIZE;
+  last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+  if (uses_extents (&inode->data))
+    return extent_map (&inode->data, first, last, sectors, max);
 
+  /* Looking up a sector may replace LEAF_COPY, even for readers. */
+  lock_acquire (&inode->map_lock);
+  for (cnt = 0; cnt < max && first + cnt <= last; cnt++)
+    sectors[cnt] = index_to_sector (inode, first + cnt, false, 0);
+  lock_release (&inode->map_lock);
+  return cnt;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Table of open inodes, keyed by sector, so that opening a single
+   inode twice returns the same `struct inode'.  It also holds
+   recently closed inodes, oldest first in CLOSED_INODES_LIST, so
+   that reopening one does not read its sector again.
+   OPEN_INODES_LOCK protects both, as well as every inode's
+   OPEN_CNT, REMOVED and LOADING.  INODE_LOADED is signaled when an
+   inode that was being read in is ready. */
+static struct hash open_inodes;
+static struct list closed_inodes;
+static size_t closed_cnt;
+static struct lock open_inodes_lock;
+static struct condition inode_loaded;
+
+/* Layout given to newly created inodes. */
+static enum inode_layout new_layout = INODE_LAYOUT_POINTERS;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode table allocation failed");
+  list_init (&closed_inodes);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
+}
+
+/* Returns the inode in the open inode table for SECTOR, or a null
+   pointer if there is none.  Caller must hold open_inodes_lock. */
+static struct inode *
+inode_lookup (block_sector_t sector)
+{
+  /* A `struct inode' is too big for the kernel stack.  The lock
+     that the caller holds protects KEY too. */
+  static struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct inode, hash_elem) : NULL;
+}
+
+/* Removes closed INODE from the open inode table and frees it.
+   Caller must hold open_inodes_lock. */
+static void
+inode_forget (struct inode *inode)
+{
+  ASSERT (inode->open_cnt == 0);
+
+  hash_delete (&open_inodes, &inode->hash_elem);
+  list_remove (&inode->closed_elem);
+  closed_cnt--;
+  drop_index_copies (inode);
+  free (inode);
+}
+
+/* Makes inodes created from now on use LAYOUT. */
+void
+inode_set_layout (enum inode_layout layout)
+{
+  new_layout = layout;
+}
+
+/* Returns the layout that INODE uses. */
+enum inode_layout
+inode_get_layout (const struct inode *inode)
+{
+  return (uses_extents (&inode->data)
+          ? INODE_LAYOUT_EXTENTS : INODE_LAYOUT_POINTERS);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -204,76 +687,138 @@ inode_init (void)
 bool
 inode_create (block_sector_t sector, off_t length, bool is_directory)
 {
-  struct inode_disk *disk_inode = NULL;
+  struct inode *inode;
   bool success = false;
 
   ASSERT (length >= 0);
 
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
-  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof inode->data == BLOCK_SECTOR_SIZE);
 
-  disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+  /* Nothing cached about whatever SECTOR used to hold is valid. */
+  lock_acquire (&open_inodes_lock);
+  inode = inode_lookup (sector);
+  if (inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      disk_inode->is_directory = is_directory;
-      if (inode_alloc(disk_inode, length)) 
+      ASSERT (inode->open_cnt == 0);
+      inode_forget (inode);
+    }
+  lock_release (&open_inodes_lock);
+
+  /* Build the inode in a private `struct inode', so that its
+     sectors are allocated the same way as when a file grows. */
+  inode = calloc (1, sizeof *inode);
+  if (inode != NULL)
+    {
+      bool changed;
+
+      /* A small file keeps its data in the inode until it grows,
+         and a pointer-layout file starts out as one big hole. */
+      inode->sector = sector;
+      inode->data.magic = (new_layout == INODE_LAYOUT_EXTENTS
+                           ? INODE_EXTENT_MAGIC : INODE_MAGIC);
+      inode->data.is_directory = is_directory;
+      inode->data.is_inline = length <= INODE_INLINE_BYTES;
+      if (inode_allocate (inode, length, 0, false, &changed)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          // if (sectors > 0) 
-          //   {
-          //     static char zeros[BLOCK_SECTOR_SIZE];
-          //     size_t i;
-              
-          //     for (i = 0; i < sectors; i++) 
-          //       block_write (fs_device, disk_inode->start + i, zeros);
-          //   }
+          inode->data.length = length;
+          journal_write (sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
           success = true; 
         } 
-      free (disk_inode);
+      else
+        inode_release_sectors (inode);
+      drop_index_copies (inode);
+      free (inode);
     }
-  //  printf("\n\nSUCCESS %d\n\n", success);
   return success;
 }
 
 
 
+/* Returns true if on-disk inode D holds an inode at all. */
+static bool
+is_inode (const struct inode_disk *d)
+{
+  return d->magic == INODE_MAGIC || d->magic == INODE_EXTENT_MAGIC;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
+   Returns a null pointer if memory allocation fails or if SECTOR
+   does not hold an inode.
+
+   The inode enters the open inode table, marked as loading, before
+   it is read, so that open_inodes_lock is not held across the
+   read.  Anyone who opens it meanwhile waits for the read. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&open_inodes_lock);
+
+  /* Check whether this inode is already open or recently closed. */
+  inode = inode_lookup (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      if (inode->open_cnt++ == 0)
+        {
+          list_remove (&inode->closed_elem);
+          closed_cnt--;
+        }
+      while (inode->loading)
+        cond_wait (&inode_loaded, &open_inodes_lock);
+      if (!is_inode (&inode->data))
         {
-          inode_reopen (inode);
-          return inode; 
+          /* The opener that read it has already taken it out of
+             the table.  The last one out frees it. */
+          if (--inode->open_cnt == 0)
+            free (inode);
+          inode = NULL;
         }
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->loading = true;
+  inode->indirect_copy = inode->doubly_copy = inode->leaf_copy = NULL;
+  inode->alloc_goal = 0;
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->map_lock);
+  rwlock_init (&inode->dir_lock);
+  hash_insert (&open_inodes, &inode->hash_elem);
+  lock_release (&open_inodes_lock);
+
+  cache_read (inode->sector, &inode->data);
+
+  lock_acquire (&open_inodes_lock);
+  inode->loading = false;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+
+  /* The magic number identifies the layout.  Refuse anything that
+     is not an inode at all. */
+  if (!is_inode (&inode->data))
+    {
+      hash_delete (&open_inodes, &inode->hash_elem);
+      if (--inode->open_cnt == 0)
+        free (inode);
+      inode = NULL;
+    }
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -282,7 +827,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -294,8 +843,11 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it among the
+   recently closed inodes, freeing the oldest of those if there are
+   too many.
+   If INODE was also a removed inode, frees its blocks and its
+   memory. */
 void
 inode_close (struct inode *inode) 
 {
@@ -303,22 +855,33 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          // inode_dealloc(inode);
-          // free_map_release (inode->data, bytes_to_sectors (inode->data.length)); 
-        }
+      lock_release (&open_inodes_lock);
+      return;
+    }
+
+  /* This was the last opener. */
+  if (inode->removed) 
+    {
+      hash_delete (&open_inodes, &inode->hash_elem);
+      lock_release (&open_inodes_lock);
 
+      /* Deallocate blocks. */
+      inode_release_sectors (inode);
+      journal_release (inode->sector, 1);
+      drop_index_copies (inode);
       free (inode); 
+      return;
     }
+
+  list_push_back (&closed_inodes, &inode->closed_elem);
+  closed_cnt++;
+  while (closed_cnt > CLOSED_INODES)
+    inode_forget (list_entry (list_front (&closed_inodes),
+                              struct inode, closed_elem));
+  lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -327,7 +890,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -338,12 +903,25 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t sectors[MAP_BATCH];
+  size_t sector_cnt = 0, sector_pos = 0;
 
+  rwlock_acquire_read (&inode->rwlock);
+  if (uses_inline (&inode->data))
+    {
+      if (offset < inode->data.length && size > 0)
+        {
+          bytes_read = inode->data.length - offset;
+          if (bytes_read > size)
+            bytes_read = size;
+          memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+        }
+      size = 0;
+    }
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -356,40 +934,107 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Map the next batch of sectors once the last one is used up. */
+      if (sector_pos == sector_cnt)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          sector_cnt = inode_map_range (inode, offset, size, sectors,
+                                        MAP_BATCH);
+          sector_pos = 0;
+          if (sector_cnt == 0)
+            break;
         }
+      sector_idx = sectors[sector_pos++];
+
+      /* Copy straight from the cache into the caller's buffer.  A
+         hole reads as zeros without touching the disk. */
+      if (sector_idx != 0)
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
+/* Initializes read-ahead state RA for a new opener of an inode.
+   A first read from the start of the file counts as sequential. */
+void
+inode_readahead_init (struct inode_readahead *ra)
+{
+  ra->next = 0;
+  ra->queued = 0;
+  ra->window = 0;
+}
+
+/* Updates read-ahead state RA after a read of SIZE bytes at OFFSET
+   in INODE.  If the read continued where the previous one left
+   off, queues the sectors that follow it for prefetching, doubling
+   the prefetch window on each sequential read up to
+   READ_AHEAD_MAX sectors.  Any other access pattern resets the
+   window, so random reads trigger no prefetching at all. */
+void
+inode_read_ahead (struct inode *inode, struct inode_readahead *ra,
+                  off_t offset, off_t size)
+{
+  off_t start, end, pos;
+
+  if (size <= 0)
+    return;
+
+  if (offset != ra->next)
+    {
+      /* A seek, perhaps backward, so forget what was queued. */
+      ra->window = 0;
+      ra->queued = 0;
+    }
+  else if (ra->window == 0)
+    ra->window = READ_AHEAD_MIN;
+  else if (ra->window < READ_AHEAD_MAX)
+    ra->window = ra->window * 2 < READ_AHEAD_MAX ? ra->window * 2
+                                                 : READ_AHEAD_MAX;
+  ra->next = offset + size;
+  if (ra->window == 0)
+    return;
+
+  /* Queue the sectors in the window that have not been queued
+     already, stopping at end of file. */
+  start = ROUND_UP (ra->next, BLOCK_SECTOR_SIZE);
+  if (start < ra->queued)
+    start = ra->queued;
+  end = ra->next + ra->window * BLOCK_SECTOR_SIZE;
+  rwlock_acquire_read (&inode->rwlock);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (pos = start; pos < end; )
+    {
+      block_sector_t sectors[MAP_BATCH];
+      size_t cnt = inode_map_range (inode, pos, end - pos, sectors, MAP_BATCH);
+      size_t i;
+
+      if (cnt == 0)
+        break;
+      for (i = 0; i < cnt; i++)
+        if (sectors[i] != 0)
+          cache_prefetch (sectors[i]);
+      pos += cnt * BLOCK_SECTOR_SIZE;
+    }
+  rwlock_release_read (&inode->rwlock);
+  if (end > ra->queued)
+    ra->queued = end;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if an error occurs.  A write past end of file
+   extends the inode, and a write into a hole allocates the
+   sectors it touches. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -397,26 +1042,44 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t sectors[MAP_BATCH];
+  size_t sector_cnt = 0, sector_pos = 0;
+  bool allocated, changed;
 
+  rwlock_acquire_write (&inode->rwlock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rwlock);
+      return 0;
+    }
 
-  if(offset+size > inode->data.length){
-    //printf("\n\n\nWRITEAT\n\n\n");
-    if(!inode_alloc(&inode->data, offset + size)){
-      //printf("\n\n\nWRITEAT FAIL\n\n\n");
+  /* Allocate sectors for holes and growth.  Write back the inode
+     even on failure, since some sectors may have been allocated. */
+  allocated = inode_allocate (inode, offset, size, true, &changed);
+  if (allocated && offset + size > inode->data.length)
+    {
+      inode->data.length = offset + size;
+      changed = true;
+    }
+  if (allocated && uses_inline (&inode->data) && size > 0)
+    {
+      memcpy (inode->data.inline_data + offset, buffer, size);
+      bytes_written = size;
+      size = 0;
+      changed = true;
+    }
+  if (changed)
+    journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  if (!allocated)
+    {
+      rwlock_release_write (&inode->rwlock);
       return 0;
     }
-    
-    inode->data.length = offset + size;
-    block_write(fs_device, inode->sector, &inode->data);
-    //printf("\n\n\nWRITEAT SUCCESSSSS\n\n\n");
-  }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -429,49 +1092,66 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Map the next batch of sectors once the last one is used up. */
+      if (sector_pos == sector_cnt)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          sector_cnt = inode_map_range (inode, offset, size, sectors,
+                                        MAP_BATCH);
+          sector_pos = 0;
+          if (sector_cnt == 0)
+            break;
         }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+      sector_idx = sectors[sector_pos++];
+      if (sector_idx == 0)
+        break;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* Copy straight from the caller's buffer into the cache,
+         which reads in the rest of a partly written sector.
+         Directory contents are metadata, so they go through the
+         journal. */
+      if (inode->data.is_directory)
+        journal_write (sector_idx, buffer + bytes_written, sector_ofs,
+                       chunk_size);
+      else
+        cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                        chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+  rwlock_release_write (&inode->rwlock);
 
   return bytes_written;
 }
 
+/* Allocates every sector of INODE's first LENGTH bytes that is
+   still a hole, without changing INODE's length, so that later
+   writes there cannot fail for lack of space.  Returns true if
+   successful, false if the disk is full. */
+bool
+inode_reserve (struct inode *inode, off_t length)
+{
+  bool allocated, changed;
+
+  rwlock_acquire_write (&inode->rwlock);
+  allocated = inode_allocate (inode, 0, length, false, &changed);
+  if (changed)
+    journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  rwlock_release_write (&inode->rwlock);
+  return allocated;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -480,9 +1160,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -497,4 +1179,22 @@ bool inode_is_dir(struct inode *inode){
     return true;
   }
   return false;
-}
\ No newline at end of file
+}
+
+/* Returns a hash value for the sector of inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, hash_elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode A has a lower sector than inode B. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, hash_elem);
+  const struct inode *b = hash_entry (b_, struct inode, hash_elem);
+  return a->sector < b->sector;
+}
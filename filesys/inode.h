@@ -2,16 +2,36 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <hash.h>
 #include <list.h>
 
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include "threads/synch.h"
 
 
-/* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
+/* Identifies an inode.  The magic number also tells which layout
+   the inode uses to map its data sectors. */
+#define INODE_MAGIC 0x494e4f44          /* Pointer layout. */
+#define INODE_EXTENT_MAGIC 0x494e4f45   /* Extent layout. */
 #define DIRECT_BLOCKS 123
 #define INDIRECT_BLOCKS 128
+#define INODE_EXTENTS 62
+#define INODE_INLINE_BYTES 500
+
+/* Layouts for an inode's map of data sectors. */
+enum inode_layout
+  {
+    INODE_LAYOUT_POINTERS,      /* Direct, indirect and doubly indirect. */
+    INODE_LAYOUT_EXTENTS        /* Runs of consecutive sectors. */
+  };
+
+/* A run of LENGTH consecutive sectors starting at START. */
+struct inode_extent
+  {
+    block_sector_t start;               /* First sector. */
+    uint32_t length;                    /* Number of sectors. */
+  };
 
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
@@ -20,36 +40,96 @@ struct inode_disk
     
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-  //  uint32_t unused[125];               /* Not used. */
     bool is_directory;
-    block_sector_t direct[DIRECT_BLOCKS]; //the direct block
-    block_sector_t indirect;  //indirect block->contains 127
-    block_sector_t doubly_indirect;  //doubly indirect-> each indirect element has one indrect block
+    bool is_inline;                     /* Data held in INLINE_DATA? */
+    union
+      {
+        /* Inline data, used if IS_INLINE is true, in which case the
+           magic number gives the layout to use once the data
+           outgrows the inode. */
+        uint8_t inline_data[INODE_INLINE_BYTES];
+
+        /* Pointer layout, used if MAGIC is INODE_MAGIC. */
+        struct
+          {
+            block_sector_t direct[DIRECT_BLOCKS]; //the direct block
+            block_sector_t indirect;  //indirect block->contains 127
+            block_sector_t doubly_indirect;  //doubly indirect-> each indirect element has one indrect block
+          };
 
+        /* Extent layout, used if MAGIC is INODE_EXTENT_MAGIC.
+           The extents map the file's sectors in order. */
+        struct
+          {
+            uint32_t extent_cnt;                /* Extents in use. */
+            struct inode_extent extents[INODE_EXTENTS];
+          };
+      };
   };
 
 struct bitmap;
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   RWLOCK is held for reading while reading the inode's data and
+   for writing while writing it, which may change DATA and the
+   index copies, or DENY_WRITE_CNT.  MAP_LOCK serializes readers'
+   use of the index copies.  DIR_LOCK is held for reading while
+   looking up a directory's entries and for writing while adding or
+   removing them; directory.c acquires it before RWLOCK. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in open inode table. */
+    struct list_elem closed_elem;       /* Element in closed inode list. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    int open_cnt;                       /* Number of openers, 0 if closed
+                                           but still cached. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool loading;                       /* Being read from disk? */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+
+    /* Copies of index blocks, loaded on first use and kept in step
+       with the buffer cache whenever a pointer in them changes.
+       Null if not loaded. */
+    block_sector_t *indirect_copy;      /* Copy of data.indirect. */
+    block_sector_t *doubly_copy;        /* Copy of data.doubly_indirect. */
+    block_sector_t *leaf_copy;          /* One second-level block. */
+    size_t leaf_idx;                    /* Index of LEAF_COPY in DOUBLY_COPY. */
+    block_sector_t alloc_goal;          /* Sector to allocate next, or 0. */
+
+    struct rwlock rwlock;               /* Protects data and mapping. */
+    struct lock map_lock;               /* Protects index copies. */
+    struct rwlock dir_lock;             /* Protects directory entries. */
+  };
+
+/* Sequential read-ahead state, kept separately for each opener
+   of an inode (see struct file). */
+struct inode_readahead
+  {
+    off_t next;                         /* Where a sequential read starts. */
+    off_t queued;                       /* End of data already prefetched. */
+    int window;                         /* Sectors to prefetch, 0 if random. */
   };
 
 void inode_init (void);
+void inode_set_layout (enum inode_layout);
+enum inode_layout inode_get_layout (const struct inode *);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_mark_used (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_reserve (struct inode *, off_t length);
+size_t inode_map_range (struct inode *, off_t offset, off_t size,
+                        block_sector_t sectors[], size_t max);
+void inode_readahead_init (struct inode_readahead *);
+void inode_read_ahead (struct inode *, struct inode_readahead *,
+                       off_t offset, off_t size);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
@@ -0,0 +1,405 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Inode sectors, index blocks and directory contents are written
+   through journal_write() inside handles that journal_begin() and
+   journal_end() bracket, one per file system operation.  The
+   sectors that the handles write join the running transaction,
+   and their buffer cache entries are held back from the disk
+   until it commits.  A commit, which happens when no handle is
+   active, writes the data sectors the cache holds, then copies of
+   the transaction's sectors into the journal, then a descriptor
+   naming them, and only then lets the sectors go to their home
+   locations.  Many operations thus share one journal write.
+
+   If the system stops after the descriptor is written but before
+   the home locations are, journal_open() writes the copies home
+   again at the next boot, so an operation is either entirely on
+   disk or not at all.  The free map is not journaled, because
+   filesys_init() rebuilds it after any unclean shutdown.  Sectors
+   freed through journal_release() stay allocated until the running
+   transaction commits, though, so that they cannot be reused by
+   another file while the operation that freed them could still
+   be lost in a crash.
+
+   A transaction holds at most a quarter of the buffer cache's
+   sectors, so that cache eviction always finds an entry that is
+   not held back.  Once it is half full, new handles wait for it
+   to commit.  If a single operation writes so
+   many sectors that the transaction fills up anyway, the rest are
+   written without the journal. */
+
+/* Header sector, at JOURNAL_START. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Sequence number to replay. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8];
+  };
+
+/* Descriptor sector, at JOURNAL_START + 1, written last in a
+   commit.  Transaction SEQ is committed if the header's sequence
+   number is also SEQ.  Its sectors' images follow in order. */
+struct journal_descriptor
+  {
+    uint32_t magic;                     /* DESCRIPTOR_MAGIC. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    block_sector_t sectors[JOURNAL_MAX]; /* Home sectors of the images. */
+  };
+
+#define JOURNAL_MAGIC 0x4c4e524a        /* "JRNL". */
+#define DESCRIPTOR_MAGIC 0x4353444a     /* "JDSC". */
+
+/* Number of images written with a single request. */
+#define IMAGE_BATCH (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* True if the file system device has a journal. */
+static bool active;
+
+/* The running transaction. */
+static struct journal_descriptor txn;
+static size_t txn_max;                  /* Most sectors TXN may hold. */
+static size_t txn_commit;               /* Size at which TXN commits. */
+static uint32_t seq;                    /* Header's sequence number. */
+
+/* A run of sectors freed in the running transaction. */
+struct pending_free
+  {
+    block_sector_t start;               /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+  };
+
+/* Sectors to return to the free map once TXN commits. */
+static struct pending_free *pending;
+static size_t pending_cnt, pending_max;
+
+/* Number of open handles, and whether a commit is waiting for
+   them to close. */
+static int handle_cnt;
+static bool commit_wanted;
+
+/* Protects all of the above.  HANDLES_DONE is signaled when the
+   last handle closes, and COMMITTED when a commit finishes. */
+static struct lock journal_lock;
+static struct condition handles_done;
+static struct condition committed;
+
+/* Buffer for a batch of images. */
+static uint8_t *image_buf;
+
+static void commit_locked (void);
+static void write_header (void);
+
+/* Initializes the journal module. */
+void
+journal_init (void)
+{
+  lock_init (&journal_lock);
+  cond_init (&handles_done);
+  cond_init (&committed);
+  image_buf = palloc_get_page (0);
+  if (image_buf == NULL)
+    PANIC ("can't allocate journal buffer");
+
+  ASSERT (sizeof txn == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+
+  txn_max = cache_size () / 4;
+  if (txn_max < 2)
+    txn_max = 2;
+  if (txn_max > JOURNAL_MAX)
+    txn_max = JOURNAL_MAX;
+  txn_commit = txn_max / 2;
+}
+
+/* Reserves the journal region on a newly formatted file system
+   and writes an empty journal there.  Must be called before
+   anything else is allocated. */
+void
+journal_create (void)
+{
+  free_map_mark (JOURNAL_START, JOURNAL_SECTORS);
+  seq = 1;
+  write_header ();
+  memset (&txn, 0, sizeof txn);
+  block_write (fs_device, JOURNAL_START + 1, &txn);
+  active = true;
+}
+
+/* Looks for a journal on the file system device and replays the
+   transaction in it, if one committed without reaching its home
+   locations.  Must be called before anything reads the file system
+   through the buffer cache.  Returns true if there is a journal. */
+bool
+journal_open (void)
+{
+  struct journal_header *h;
+  struct journal_descriptor *d;
+
+  h = malloc (sizeof *h);
+  d = malloc (sizeof *d);
+  if (h == NULL || d == NULL)
+    PANIC ("can't allocate journal buffers");
+
+  block_read (fs_device, JOURNAL_START, h);
+  active = h->magic == JOURNAL_MAGIC;
+  if (active)
+    {
+      seq = h->seq;
+      block_read (fs_device, JOURNAL_START + 1, d);
+      if (d->magic == DESCRIPTOR_MAGIC && d->seq == seq
+          && d->cnt <= JOURNAL_MAX)
+        {
+          size_t i;
+
+          printf ("Replaying journal...");
+          for (i = 0; i < d->cnt; i++)
+            {
+              block_read (fs_device, JOURNAL_START + 2 + i, image_buf);
+              block_write (fs_device, d->sectors[i], image_buf);
+            }
+          seq++;
+          write_header ();
+          printf ("done.\n");
+        }
+    }
+  free (h);
+  free (d);
+  return active;
+}
+
+/* Returns true if the file system device has a journal. */
+bool
+journal_active (void)
+{
+  return active;
+}
+
+/* Marks the journal region, if there is one, as in use in the free
+   map, for rebuilding the free map after a crash. */
+void
+journal_mark_used (void)
+{
+  if (active)
+    free_map_mark (JOURNAL_START, JOURNAL_SECTORS);
+}
+
+/* Opens a handle for a file system operation, so that everything
+   it writes through journal_write() commits together.  Handles
+   nest, and only the outermost one has any effect.  The outermost
+   one waits while a commit is pending, so it must not be opened
+   while holding any file system lock. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!active || t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (commit_wanted
+         || (txn.cnt > 0 && txn.cnt >= txn_commit))
+    {
+      if (handle_cnt == 0)
+        commit_locked ();
+      else
+        {
+          commit_wanted = true;
+          cond_wait (&committed, &journal_lock);
+        }
+    }
+  handle_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Closes a handle opened by journal_begin().  Closing the last
+   open handle commits the transaction if one is pending or the
+   transaction is full enough. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!active)
+    return;
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  if (--handle_cnt == 0)
+    {
+      cond_broadcast (&handles_done, &journal_lock);
+      if (commit_wanted || (txn.cnt > 0 && txn.cnt >= txn_commit))
+        commit_locked ();
+    }
+  lock_release (&journal_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into metadata SECTOR, starting at
+   byte offset OFS within it, as part of the running transaction.
+   Outside any handle, joins the transaction without waiting for a
+   pending commit, since the caller may hold locks that the open
+   handles need. */
+void
+journal_write (block_sector_t sector, const void *buffer, size_t ofs,
+               size_t size)
+{
+  struct thread *t = thread_current ();
+  bool journaled = false;
+  size_t i;
+
+  if (!active)
+    {
+      cache_write_at (sector, buffer, ofs, size);
+      return;
+    }
+
+  lock_acquire (&journal_lock);
+  if (t->journal_depth++ == 0)
+    handle_cnt++;
+  for (i = 0; i < txn.cnt; i++)
+    if (txn.sectors[i] == sector)
+      break;
+  if (i < txn.cnt)
+    journaled = true;
+  else if (txn.cnt < txn_max)
+    {
+      txn.sectors[txn.cnt++] = sector;
+      journaled = true;
+    }
+  lock_release (&journal_lock);
+
+  if (journaled)
+    cache_write_journaled (sector, buffer, ofs, size);
+  else
+    cache_write_at (sector, buffer, ofs, size);
+  journal_end ();
+}
+
+/* Frees CNT sectors starting at SECTOR, like free_map_release(),
+   but not until the running transaction commits.  If memory is
+   too short to remember them, they stay allocated until the free
+   map is next rebuilt, which is safe, unlike freeing them early. */
+void
+journal_release (block_sector_t sector, size_t cnt)
+{
+  if (!active)
+    {
+      free_map_release (sector, cnt);
+      return;
+    }
+
+  lock_acquire (&journal_lock);
+  if (pending_cnt == pending_max)
+    {
+      size_t new_max = pending_max * 2 + 16;
+      struct pending_free *p = realloc (pending, new_max * sizeof *p);
+      if (p != NULL)
+        {
+          pending = p;
+          pending_max = new_max;
+        }
+    }
+  if (pending_cnt < pending_max)
+    {
+      pending[pending_cnt].start = sector;
+      pending[pending_cnt].cnt = cnt;
+      pending_cnt++;
+    }
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction, waiting for open handles to
+   close first. */
+void
+journal_commit (void)
+{
+  if (!active)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (handle_cnt > 0)
+    {
+      commit_wanted = true;
+      cond_wait (&handles_done, &journal_lock);
+    }
+  commit_locked ();
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction.  The caller must hold
+   journal_lock, and no handle may be open. */
+static void
+commit_locked (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (handle_cnt == 0);
+
+  if (txn.cnt > 0)
+    {
+      /* Data first, so that committed metadata never points to
+         data that is not on disk. */
+      cache_flush ();
+
+      /* Copy the images into the journal, then commit them by
+         writing the descriptor. */
+      for (i = 0; i < txn.cnt; i += IMAGE_BATCH)
+        {
+          size_t cnt = txn.cnt - i < IMAGE_BATCH ? txn.cnt - i : IMAGE_BATCH;
+          size_t j;
+
+          for (j = 0; j < cnt; j++)
+            cache_read (txn.sectors[i + j], image_buf + j * BLOCK_SECTOR_SIZE);
+          block_write_multiple (fs_device, JOURNAL_START + 2 + i, cnt,
+                                image_buf);
+        }
+      txn.magic = DESCRIPTOR_MAGIC;
+      txn.seq = seq;
+      block_write (fs_device, JOURNAL_START + 1, &txn);
+
+      /* Write the sectors home, then retire the transaction. */
+      for (i = 0; i < txn.cnt; i++)
+        cache_release_journaled (txn.sectors[i]);
+      cache_flush ();
+      seq++;
+      write_header ();
+      txn.cnt = 0;
+    }
+
+  /* Whatever freed these sectors is now on disk. */
+  for (i = 0; i < pending_cnt; i++)
+    free_map_release (pending[i].start, pending[i].cnt);
+  pending_cnt = 0;
+
+  commit_wanted = false;
+  cond_broadcast (&committed, &journal_lock);
+}
+
+/* Writes the journal header with sequence number SEQ. */
+static void
+write_header (void)
+{
+  struct journal_header *h = (struct journal_header *) image_buf;
+
+  memset (h, 0, sizeof *h);
+  h->magic = JOURNAL_MAGIC;
+  h->seq = seq;
+  block_write (fs_device, JOURNAL_START, h);
+}
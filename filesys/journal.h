@@ -0,0 +1,28 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* The journal occupies a fixed region of the file system device,
+   right after the free map and root directory inodes: a header
+   sector, a descriptor sector, and room for JOURNAL_MAX sector
+   images. */
+#define JOURNAL_START 2
+#define JOURNAL_MAX 125
+#define JOURNAL_SECTORS (2 + JOURNAL_MAX)
+
+void journal_init (void);
+void journal_create (void);
+bool journal_open (void);
+bool journal_active (void);
+void journal_mark_used (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_write (block_sector_t, const void *, size_t ofs, size_t size);
+void journal_release (block_sector_t, size_t);
+void journal_commit (void);
+
+#endif /* filesys/journal.h */
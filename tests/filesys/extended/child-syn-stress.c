@@ -0,0 +1,60 @@
+/* Child process for syn-stress.
+   Alternately reads a chunk of the shared file, which our parent
+   wrote, and appends a chunk to a file of our own, then reads our
+   own file back. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-stress.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-syn-stress";
+
+static char expected[BUF_SIZE];
+static char own[BUF_SIZE];
+static char buf[BUF_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char own_name[16];
+  int child_idx;
+  int shared_fd, own_fd;
+  size_t ofs;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (expected, sizeof expected);
+  memset (own, 'a' + child_idx, sizeof own);
+
+  snprintf (own_name, sizeof own_name, "file%d", child_idx);
+  CHECK (create (own_name, 0), "create \"%s\"", own_name);
+  CHECK ((own_fd = open (own_name)) > 1, "open \"%s\"", own_name);
+  CHECK ((shared_fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+
+  for (ofs = 0; ofs < BUF_SIZE; ofs += CHUNK_SIZE)
+    {
+      CHECK (read (shared_fd, buf + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+             "read %d bytes at offset %zu in \"%s\"",
+             CHUNK_SIZE, ofs, shared_name);
+      compare_bytes (buf + ofs, expected + ofs, CHUNK_SIZE, ofs, shared_name);
+      CHECK (write (own_fd, own + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+             "write %d bytes at offset %zu in \"%s\"",
+             CHUNK_SIZE, ofs, own_name);
+    }
+  close (shared_fd);
+
+  seek (own_fd, 0);
+  CHECK (read (own_fd, buf, BUF_SIZE) == BUF_SIZE, "read \"%s\"", own_name);
+  compare_bytes (buf, own, BUF_SIZE, 0, own_name);
+  close (own_fd);
+
+  return child_idx;
+}
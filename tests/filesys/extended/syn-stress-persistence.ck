@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"child-syn-stress" => "tests/filesys/extended/child-syn-stress",
+		"shared" => [random_bytes (64 * 64)],
+		map (("file$_" => [chr (ord ('a') + $_) x (64 * 64)]), 0..7)});
+pass;
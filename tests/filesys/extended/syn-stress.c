@@ -0,0 +1,28 @@
+/* Spawns many child processes, each of which reads a shared file
+   while it grows a file of its own, so that the file system sees
+   concurrent reads of one file and concurrent writes to many. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-stress.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[BUF_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd;
+
+  CHECK (create (shared_name, 0), "create \"%s\"", shared_name);
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == BUF_SIZE, "write \"%s\"", shared_name);
+  msg ("close \"%s\"", shared_name);
+  close (fd);
+
+  exec_children ("child-syn-stress", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-stress) begin
+(syn-stress) create "shared"
+(syn-stress) open "shared"
+(syn-stress) write "shared"
+(syn-stress) close "shared"
+(syn-stress) exec child 1 of 8: "child-syn-stress 0"
+(syn-stress) exec child 2 of 8: "child-syn-stress 1"
+(syn-stress) exec child 3 of 8: "child-syn-stress 2"
+(syn-stress) exec child 4 of 8: "child-syn-stress 3"
+(syn-stress) exec child 5 of 8: "child-syn-stress 4"
+(syn-stress) exec child 6 of 8: "child-syn-stress 5"
+(syn-stress) exec child 7 of 8: "child-syn-stress 6"
+(syn-stress) exec child 8 of 8: "child-syn-stress 7"
+(syn-stress) wait for child 1 of 8 returned 0 (expected 0)
+(syn-stress) wait for child 2 of 8 returned 1 (expected 1)
+(syn-stress) wait for child 3 of 8 returned 2 (expected 2)
+(syn-stress) wait for child 4 of 8 returned 3 (expected 3)
+(syn-stress) wait for child 5 of 8 returned 4 (expected 4)
+(syn-stress) wait for child 6 of 8 returned 5 (expected 5)
+(syn-stress) wait for child 7 of 8 returned 6 (expected 6)
+(syn-stress) wait for child 8 of 8 returned 7 (expected 7)
+(syn-stress) end
+EOF
+pass;
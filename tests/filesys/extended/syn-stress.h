@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_STRESS_H
+#define TESTS_FILESYS_EXTENDED_SYN_STRESS_H
+
+#define CHILD_CNT 8
+#define CHUNK_SIZE 64
+#define CHUNK_CNT 64
+#define BUF_SIZE (CHUNK_SIZE * CHUNK_CNT)
+static const char shared_name[] = "shared";
+
+#endif /* tests/filesys/extended/syn-stress.h */
@@ -34,9 +34,16 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -127,6 +134,13 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  frame_init ();
+  swap_init ();
+  share_init ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -242,14 +256,24 @@ parse_options (char **argv)
         shutdown_configure (SHUTDOWN_REBOOT);
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
-        format_filesys = true;
+        {
+          format_filesys = true;
+          if (value != NULL && !filesys_set_format_options (value))
+            PANIC ("unknown format option in `%s'", value);
+        }
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_configure (atoi (value));
+      else if (!strcmp (name, "-cache-dirty"))
+        cache_configure_high_water (atoi (value));
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-stack"))
+        page_set_stack_limit ((size_t) atoi (value) * 1024 * 1024);
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
@@ -370,11 +394,17 @@ usage (void)
           "  -q                 Power off VM after actions or on panic.\n"
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
-          "  -f                 Format file system device during startup.\n"
+          "  -f[=OPT,...]       Format file system device during startup.\n"
+          "                     OPT is `extents' or `pointers' (default),\n"
+          "                     or `nojournal' to format without a journal,\n"
+          "                     or `crc' to keep per-sector checksums.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=SECTORS     Size the buffer cache to SECTORS sectors.\n"
+          "  -cache-dirty=SECTORS  Make writers flush above SECTORS dirty.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -stack=MB          Let user stacks grow to MB megabytes (default 8).\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
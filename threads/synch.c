@@ -336,3 +336,80 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RW.  Any number of readers may
+   hold RW at once, or a single writer.  A waiting writer keeps new
+   readers out, so that a steady stream of readers cannot starve
+   it.
+
+   Like a lock, an RW lock may not be acquired recursively, and it
+   may not be acquired from within an interrupt handler. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers);
+  cond_init (&rw->writers);
+  rw->reader_cnt = 0;
+  rw->writer_wait_cnt = 0;
+  rw->writer = false;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  while (rw->writer || rw->writer_wait_cnt > 0)
+    cond_wait (&rw->readers, &rw->lock);
+  rw->reader_cnt++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0)
+    cond_signal (&rw->writers, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or other
+   writer holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  rw->writer_wait_cnt++;
+  while (rw->writer || rw->reader_cnt > 0)
+    cond_wait (&rw->writers, &rw->lock);
+  rw->writer_wait_cnt--;
+  rw->writer = true;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for writing.
+   Hands RW to the next waiting writer, if any, or else to all of
+   the waiting readers. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer);
+  rw->writer = false;
+  if (rw->writer_wait_cnt > 0)
+    cond_signal (&rw->writers, &rw->lock);
+  else
+    cond_broadcast (&rw->readers, &rw->lock);
+  lock_release (&rw->lock);
+}
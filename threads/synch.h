@@ -41,6 +41,23 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers;   /* Readers waiting to enter. */
+    struct condition writers;   /* Writers waiting to enter. */
+    unsigned reader_cnt;        /* Number of readers inside. */
+    unsigned writer_wait_cnt;   /* Number of writers waiting. */
+    bool writer;                /* True if a writer is inside. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
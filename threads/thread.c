@@ -526,6 +526,9 @@ init_thread (struct thread *t, const char *name, int priority)
   list_init(&t->children);
   list_init(&t->fd_list);
   list_init(&t->children_exit);
+#ifdef VM
+  list_init(&t->mappings);
+#endif
   t->next_file = 2;
   t->parent_tid = NULL;
 }
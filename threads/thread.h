@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include <debug.h>
@@ -92,7 +93,9 @@ typedef int tid_t;
    semaphore wait list (synch.c).  It can be used these two ways
    only because they are mutually exclusive: only a thread in the
    ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   blocked state is on a semaphore wait list.  A thread blocked in
+   timer_sleep() is likewise on the sleep list (timer.c) instead
+   of any semaphore wait list. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -107,6 +110,8 @@ struct thread
     bool child_load_status;
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    int64_t wakeup_tick;                /* Owned by timer.c: tick to wake
+                                           up at while in timer_sleep(). */
     struct list_elem child_elem;
     struct list children;   //list of children
     struct list children_exit;
@@ -119,10 +124,19 @@ struct thread
 
     /* Filesys */
     char* cur_dir;
+    int journal_depth;                  /* Nesting of journal handles. */
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
 #endif
+#ifdef VM
+    /* Owned by vm/page.c and vm/mmap.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping identifier. */
+    void *user_esp;                     /* User stack pointer on entry
+                                           to the current system call. */
+#endif
 
     /* Owned by thread.c. */
     unsigned magic;                    /* Detects stack overflow. */
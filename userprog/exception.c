@@ -5,6 +5,9 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -145,6 +148,21 @@ page_fault(struct intr_frame *f) {
     write = (f->error_code & PF_W) != 0;
     user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+    /* A page that is in the supplemental page table but not in
+       memory is brought in, and the access retried.  So is a new
+       stack page for an access just below the stack.  A fault taken
+       in kernel mode on a user address comes from a system call, so
+       the user stack pointer is the one saved on entry to it. */
+    if (not_present && fault_addr != NULL && is_user_vaddr(fault_addr)) {
+        void *esp = user ? f->esp : thread_current()->user_esp;
+        if (page_load(fault_addr)
+            || (page_grow_stack(fault_addr, esp) && page_load(fault_addr))) {
+            return;
+        }
+    }
+#endif
+
     //TODO: NULL, below phys base, page exists
     if (is_kernel_vaddr(fault_addr) || pagedir_get_page(thread_current()->pagedir , fault_addr) || fault_addr == NULL) {
         f->eax = -1;
@@ -17,6 +17,10 @@
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #define MAX_CMD_ARGS 30
 #define MAX_CMD_LEN 100
@@ -172,9 +176,16 @@ process_exit (int status)
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
-  file_close(cur->rox_executable);
   if (pd != NULL) 
     {
+#ifdef VM
+      /* Write back memory-mapped files and release the pages the
+         supplemental page table brought in, while PD still maps
+         them. */
+      mmap_unmap_all ();
+      page_table_destroy ();
+#endif
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
@@ -186,6 +197,9 @@ process_exit (int status)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+  /* Shared code pages are keyed by the executable, so close it only
+     once they are released. */
+  file_close(cur->rox_executable);
   sema_up(&cur->done);
   // sema_up(&parent->parent_ready);
 }
@@ -303,6 +317,10 @@ load (const char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+#endif
   process_activate ();
 
   /* Open executable file. */  
@@ -410,7 +428,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -469,6 +489,11 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, the pages are only recorded in the
+   supplemental page table here, and each is read in or zeroed
+   when the process first touches it.  FILE must then stay open
+   for as long as the process runs.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -488,6 +513,13 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Leave the page to be loaded on first access. */
+      if (page_add_file (upage, file, ofs, page_read_bytes, writable,
+                         false) == NULL)
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -507,6 +539,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -517,17 +550,26 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+   user virtual memory.  With virtual memory, the page is an
+   ordinary zero-filled page that may be evicted like any other. */
 static bool
 setup_stack (void **esp, char *file_name)
 {
-  uint8_t *kpage;
   bool success = false;
+#ifdef VM
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  if (page_add_zero (upage) != NULL)
+  {
+    success = page_load (upage);
+#else
+  uint8_t *kpage;
 
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL)
   {
     success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+#endif
     if (success){
 
       //////////////////////////////////////
@@ -574,12 +616,15 @@ setup_stack (void **esp, char *file_name)
       *esp = *esp - 4;
       (*(int *)(*esp))=0;
     }
+#ifndef VM
     else
       palloc_free_page (kpage);
+#endif
   }
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -599,3 +644,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
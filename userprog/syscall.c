@@ -3,13 +3,25 @@
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
 #include "filesys/dir-tokenizer.h"
 #include "filesys/file.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 typedef int pid_t;
 
 static void syscall_handler(struct intr_frame *);
 void check_bad_ptr(void* arg_ptr);
+static void check_buffer(void const* buffer, unsigned size, bool writable);
+static bool user_page_mapped(void const* page);
+static void release_buffer(void const* buffer, unsigned size);
+#ifdef VM
+static bool pin_user_page(void const* addr);
+#endif
 
 static bool create(const char *file, unsigned initial_size);
 static bool remove(const char *file);
@@ -18,6 +30,10 @@ static bool mkdir(const char *dir);
 static bool readdir(int fd, char* buf);
 static bool isdir(int fd);
 static int inumber(int fd);
+#ifdef VM
+static mapid_t mmap(int fd, void *addr);
+static void munmap(mapid_t mapping);
+#endif
 
 get_user (const uint8_t *uaddr)
 {
@@ -37,12 +53,18 @@ static void
 syscall_handler(struct intr_frame *f) {
     // printf("stack pointer of thread is %d\n", thread_current()->stack);
     // printf("intr_frame stack pointer is %d\n", f->esp);
-    // first check if sp and the first arg are valid
-    if (!is_user_vaddr(f->esp) || !is_user_vaddr(f->esp + 4)) {
-        exit(-1);
-    }
-    if (!pagedir_get_page(thread_current()->pagedir, f->esp) || !pagedir_get_page(thread_current()->pagedir, f->esp + 4)) {
-        exit(-1);
+#ifdef VM
+    /* Page faults taken on user buffers below the stack need the
+       user stack pointer to decide whether to grow the stack. */
+    thread_current()->user_esp = f->esp;
+#endif
+    // first check if sp and the argument slots are valid; the stack page may
+    // have been evicted since the arguments were pushed, so page it back in
+    int slot;
+    for (slot = 0; slot < 16; slot += 4) {
+        if (!is_user_vaddr(f->esp + slot) || !user_page_mapped(f->esp + slot)) {
+            exit(-1);
+        }
     }
     // int x =0;
     int syscall_number = *((int *) f->esp);
@@ -120,19 +142,21 @@ syscall_handler(struct intr_frame *f) {
             break;
         }
         case SYS_READ: {
-            check_bad_ptr(*(void**)(f->esp + 8));
             int fd = *(int *) (f->esp + 4);
             void *buffer = *(char **) (f->esp + 8);
             unsigned size = *(unsigned *) (f->esp + 12);
+            check_buffer(buffer, size, true);
             f->eax = read(fd, buffer, size);
+            release_buffer(buffer, size);
             break;
         }
         case SYS_WRITE: {
-            check_bad_ptr(*(void**)(f->esp + 8));
             int fd = *(int *) (f->esp + 4);
             void *buffer = *(char **) (f->esp + 8);
             unsigned size = *(unsigned *) (f->esp + 12);
+            check_buffer(buffer, size, false);
             f->eax = write(fd, buffer, size);
+            release_buffer(buffer, size);
             break;
 
         }
@@ -186,6 +210,21 @@ syscall_handler(struct intr_frame *f) {
             f->eax = inumber(fd);
             break;
         }
+
+#ifdef VM
+        case SYS_MMAP: {
+            int fd = *(int*)(f->esp + 4);
+            void* addr = *(void**)(f->esp + 8);
+            f->eax = mmap(fd, addr);
+            break;
+        }
+
+        case SYS_MUNMAP: {
+            mapid_t mapping = *(mapid_t*)(f->esp + 4);
+            munmap(mapping);
+            break;
+        }
+#endif
    //     case SYS_
     }
 }
@@ -483,12 +522,93 @@ void check_bad_ptr(void* arg_ptr) {
         // printf("invalid is_user_vaddr\n");
         exit(-1);
     }
-    if (!pagedir_get_page(thread_current()->pagedir, arg_ptr)) {
+    if (!user_page_mapped(arg_ptr)) {
         // printf("%s: not valid page\n", thread_current()->name);
         exit(-1);
     }
 }
 
+/*
+ * Checks that all SIZE bytes of the user buffer at BUFFER are mapped, and also
+ * writable if WRITABLE is true, and kills the process if not. Once this
+ * passes, the file system copies data between the buffer cache and BUFFER
+ * directly, without staging it in a kernel buffer. With virtual memory, the
+ * buffer's pages are also pinned in memory until release_buffer().
+ */
+static void check_buffer(void const* buffer, unsigned size, bool writable) {
+    uint8_t const* start = buffer;
+    uint8_t const* page;
+
+    if (size == 0) {
+        return;
+    }
+    if (start == NULL || start + size - 1 < start || !is_user_vaddr(start + size - 1)) {
+        exit(-1);
+    }
+    for (page = pg_round_down(start); page <= start + size - 1; page += PGSIZE) {
+#ifdef VM
+        if (!pin_user_page(page < start ? start : page)
+#else
+        if (!user_page_mapped(page)
+#endif
+            || (writable && !pagedir_is_writable(thread_current()->pagedir, page))) {
+            exit(-1);
+        }
+    }
+}
+
+#ifdef VM
+/*
+ * Brings the user page containing ADDR into memory and pins it, first growing
+ * the stack to cover ADDR if it is a plausible stack access. Returns false if
+ * ADDR is in no page of the process.
+ */
+static bool pin_user_page(void const* addr) {
+    return page_pin(addr)
+           || (page_grow_stack(addr, thread_current()->user_esp) && page_pin(addr));
+}
+#endif
+
+/*
+ * Unpins the pages of a buffer that check_buffer() accepted.
+ */
+static void release_buffer(void const* buffer, unsigned size) {
+#ifdef VM
+    uint8_t const* start = buffer;
+    uint8_t const* page;
+
+    if (size == 0) {
+        return;
+    }
+    for (page = pg_round_down(start); page <= start + size - 1; page += PGSIZE) {
+        page_unpin(page);
+    }
+#else
+    (void) buffer;
+    (void) size;
+#endif
+}
+
+/*
+ * Returns true if the user page containing PAGE is mapped. With virtual
+ * memory, a page that is in the supplemental page table is brought in first,
+ * so that the file system never faults on it while holding its own locks.
+ */
+static bool user_page_mapped(void const* page) {
+    if (pagedir_get_page(thread_current()->pagedir, page)) {
+        return true;
+    }
+#ifdef VM
+    if (!pin_user_page(page)) {
+        return false;
+    }
+    page_unpin(page);
+    return true;
+#else
+    return false;
+#endif
+}
+
 /*
  * Changes the current working directory of the process to dir,
  * which may be relative or absolute. Returns true if successful, false on failure.
@@ -496,18 +616,21 @@ void check_bad_ptr(void* arg_ptr) {
 bool chdir(const char *dirname) {
     // printf("In chdir\n");
     char* path = (char*)malloc(sizeof(char) * (DIRNAME_MAX + 1));
-    // char path[DIRNAME_MAX + 1];
-    dirtok_get_abspath(dirname, path);
+    if (path == NULL || !dirtok_get_abspath(dirname, path)) {
+        free(path);
+        return false;
+    }
     struct dir* dir = dir_open_path(path);
     if (dir) {
-        strlcpy(thread_current()->cur_dir, path, strlen(path) + 1);
-        // printf("Current thread's directory is now %s\n", thread_current()->cur_dir);
-        free(path);
+        dir_close(dir);
+        /* The old name may be shorter than the new one, so take PATH's buffer
+           instead of copying into it. */
+        free(thread_current()->cur_dir);
+        thread_current()->cur_dir = path;
         return true;
     }
     free(path);
     return false;
-    // dirtok_test();
 }
 
 /*
@@ -593,3 +716,27 @@ int inumber(int fd){
     }
     return inum;
 }
+
+#ifdef VM
+/*
+ * Maps the file open as fd into the process's virtual address space, starting
+ * at addr, which must be page-aligned. Returns a mapping identifier that is
+ * unique within the process, or MAP_FAILED if the file cannot be mapped there.
+ * The pages are read from the file only when first accessed.
+ */
+static mapid_t mmap(int fd, void *addr) {
+    struct fd_elem* fe = get_fd_element(fd);
+    if (fe == NULL || fe->isdir || fe->closed) {
+        return MAP_FAILED;
+    }
+    return mmap_map(fe->file, addr);
+}
+
+/*
+ * Unmaps the mapping designated by mapping, writing back the pages that the
+ * process modified. Unknown identifiers are ignored.
+ */
+static void munmap(mapid_t mapping) {
+    mmap_unmap(mapping);
+}
+#endif
@@ -0,0 +1,179 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* Frame table.
+
+   Every user pool page that holds a user page is in frame_list.
+   When the user pool runs dry, frame_alloc() takes a frame from
+   some page with the second-chance clock algorithm: the clock hand
+   sweeps frame_list, clearing the accessed bit of each page it
+   passes and evicting the first page whose bit is already clear.
+
+   A frame is pinned while its page is being brought in or evicted
+   and while the kernel accesses it on a process's behalf.  Frames
+   without a page, which processes share (vm/share.c), are never
+   evicted. */
+
+static struct list frame_list;      /* All frames. */
+static struct list_elem *hand;      /* Clock hand, or list end. */
+static struct lock frame_lock;      /* Protects all of the above. */
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  hand = list_end (&frame_list);
+  lock_init (&frame_lock);
+}
+
+/* Returns the frame under the clock hand and advances the hand.
+   Caller must hold frame_lock, and frame_list must not be
+   empty. */
+static struct frame *
+next_frame (void)
+{
+  struct frame *f;
+
+  if (hand == list_end (&frame_list))
+    hand = list_begin (&frame_list);
+  f = list_entry (hand, struct frame, elem);
+  hand = list_next (hand);
+  return f;
+}
+
+/* Chooses a frame with the clock algorithm and evicts its page.
+   Returns the frame, pinned, or a null pointer if no page can be
+   evicted.  Caller must hold frame_lock, which is released while
+   the page is written out. */
+static struct frame *
+evict (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * list_size (&frame_list); i++)
+    {
+      struct frame *f = next_frame ();
+      struct page *p = f->page;
+      bool evicted;
+
+      if (f->pinned || p == NULL)
+        continue;
+      if (pagedir_is_accessed (f->pagedir, p->upage))
+        {
+          pagedir_set_accessed (f->pagedir, p->upage, false);
+          continue;
+        }
+      if (!lock_try_acquire (&p->lock))
+        continue;
+
+      /* P's owner cannot free F while we hold P's lock. */
+      f->pinned = true;
+      lock_release (&frame_lock);
+      evicted = page_out (p, f);
+      if (!evicted)
+        f->pinned = false;
+      lock_release (&p->lock);
+      lock_acquire (&frame_lock);
+      if (evicted)
+        return f;
+    }
+  return NULL;
+}
+
+/* Returns a pinned frame for page P of the process whose page
+   directory is PD.  If EVICT_OK is true and the user pool is
+   exhausted, evicts another page to make room.  Returns a null
+   pointer if no frame can be had. */
+static struct frame *
+allocate (struct page *p, uint32_t *pd, bool evict_ok)
+{
+  struct frame *f;
+  void *kpage = palloc_get_page (PAL_USER);
+
+  if (kpage == NULL)
+    {
+      if (!evict_ok)
+        return NULL;
+      lock_acquire (&frame_lock);
+      f = evict ();
+      if (f != NULL)
+        {
+          f->page = p;
+          f->pagedir = pd;
+        }
+      lock_release (&frame_lock);
+      return f;
+    }
+
+  f = malloc (sizeof *f);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  f->kpage = kpage;
+  f->page = p;
+  f->pagedir = pd;
+  f->pinned = true;
+  lock_acquire (&frame_lock);
+  list_push_back (&frame_list, &f->elem);
+  lock_release (&frame_lock);
+  return f;
+}
+
+/* Returns a pinned frame for page P of the process whose page
+   directory is PD, evicting another page if necessary.  If P is a
+   null pointer, the frame is never evicted.  Returns a null
+   pointer if every page in memory is pinned or cannot be
+   evicted. */
+struct frame *
+frame_alloc (struct page *p, uint32_t *pd)
+{
+  return allocate (p, pd, true);
+}
+
+/* Like frame_alloc(), but returns a null pointer instead of
+   evicting anything, for reading pages in ahead of need. */
+struct frame *
+frame_try_alloc (struct page *p, uint32_t *pd)
+{
+  return allocate (p, pd, false);
+}
+
+/* Removes frame F from the frame table and frees it. */
+void
+frame_free (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  if (hand == &f->elem)
+    hand = list_next (hand);
+  list_remove (&f->elem);
+  lock_release (&frame_lock);
+
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Exempts frame F from eviction until frame_unpin(). */
+void
+frame_pin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pinned = true;
+  lock_release (&frame_lock);
+}
+
+/* Makes frame F eligible for eviction again. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pinned = false;
+  lock_release (&frame_lock);
+}
@@ -0,0 +1,27 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct page;
+
+/* A frame of the user pool holding a user page. */
+struct frame
+  {
+    struct list_elem elem;              /* Element in frame_list. */
+    void *kpage;                        /* Kernel virtual address. */
+    struct page *page;                  /* Page held, or null if shared. */
+    uint32_t *pagedir;                  /* Page directory mapping PAGE. */
+    bool pinned;                        /* Exempt from eviction? */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *, uint32_t *pd);
+struct frame *frame_try_alloc (struct page *, uint32_t *pd);
+void frame_free (struct frame *);
+void frame_pin (struct frame *);
+void frame_unpin (struct frame *);
+
+#endif /* vm/frame.h */
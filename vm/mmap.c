@@ -0,0 +1,140 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* A memory-mapped file.  Its pages are in the process's
+   supplemental page table and are read from the file on first
+   access.  The pages that the process modified are written back
+   when the mapping is removed, explicitly or at exit. */
+struct mapping
+  {
+    struct list_elem elem;              /* Element in thread's `mappings'. */
+    mapid_t mapid;                      /* Mapping identifier. */
+    struct file *file;                  /* The file, reopened. */
+    uint8_t *addr;                      /* Address of the first page. */
+    size_t page_cnt;                    /* Number of pages. */
+  };
+
+/* Removes the first CNT pages of mapping M from the current
+   process, writing back those that were modified. */
+static void
+unmap_pages (struct mapping *m, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    page_remove (page_lookup (m->addr + i * PGSIZE));
+}
+
+/* Maps FILE into the current process's address space, starting
+   at page-aligned user address ADDR.  Returns the new mapping's
+   identifier, or MAP_FAILED if FILE is empty, ADDR is not suitable,
+   the range overlaps pages already in use, or memory is short.
+   FILE is reopened, so the caller may close it afterward. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  uint32_t *pd = t->pagedir;
+  off_t length = file_length (file);
+  struct mapping *m;
+  size_t i;
+
+  if (length == 0 || addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (m->addr + m->page_cnt * PGSIZE < m->addr
+      || !is_user_vaddr (m->addr + m->page_cnt * PGSIZE - 1))
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = m->addr + i * PGSIZE;
+      if (page_lookup (upage) != NULL || pagedir_get_page (pd, upage) != NULL)
+        {
+          free (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (page_add_file (m->addr + ofs, m->file, ofs, read_bytes,
+                         true, true) == NULL)
+        {
+          unmap_pages (m, i);
+          file_close (m->file);
+          free (m);
+          return MAP_FAILED;
+        }
+    }
+
+  m->mapid = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  return m->mapid;
+}
+
+/* Removes mapping M, writing back the pages that were modified. */
+static void
+unmap (struct mapping *m)
+{
+  list_remove (&m->elem);
+  unmap_pages (m, m->page_cnt);
+  file_close (m->file);
+  free (m);
+}
+
+/* Removes the current process's mapping MAPID, writing back the
+   pages that were modified.  Returns false if there is no such
+   mapping. */
+bool
+mmap_unmap (mapid_t mapid)
+{
+  struct list *mappings = &thread_current ()->mappings;
+  struct list_elem *e;
+
+  for (e = list_begin (mappings); e != list_end (mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->mapid == mapid)
+        {
+          unmap (m);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Removes all of the current process's mappings, as at exit. */
+void
+mmap_unmap_all (void)
+{
+  struct list *mappings = &thread_current ()->mappings;
+
+  while (!list_empty (mappings))
+    unmap (list_entry (list_front (mappings), struct mapping, elem));
+}
@@ -0,0 +1,397 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+
+/* Most bytes a user stack may grow to. */
+static size_t stack_limit = STACK_DEFAULT_LIMIT;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+
+/* Sets the most bytes a user stack may grow to.  Called while
+   parsing the kernel command line. */
+void
+page_set_stack_limit (size_t bytes)
+{
+  if (bytes > 0 && bytes < (size_t) PHYS_BASE)
+    stack_limit = bytes;
+}
+
+/* Initializes the current process's supplemental page table.
+   Returns false if memory is short. */
+bool
+page_table_init (void)
+{
+  return hash_init (&thread_current ()->pages, page_hash, page_less, NULL);
+}
+
+/* Releases the memory or swap slot that page P occupies, writing
+   its contents back to its file first if it is a modified page of
+   a memory-mapped file.  A shared page's frame is freed only when
+   the last process lets it go. */
+static void
+page_release (struct page *p)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  void *kpage;
+
+  lock_acquire (&p->lock);
+  kpage = pagedir_get_page (pd, p->upage);
+  if (kpage != NULL)
+    {
+      if (p->mmap && pagedir_is_dirty (pd, p->upage))
+        file_write_at (p->file, kpage, p->read_bytes, p->ofs);
+      pagedir_clear_page (pd, p->upage);
+      if (p->shared)
+        share_put (p->file, p->ofs, p->read_bytes);
+      else
+        frame_free (p->frame);
+      p->frame = NULL;
+    }
+  else if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  lock_release (&p->lock);
+}
+
+/* Releases page P and frees it, as a hash_clear() destructor. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+  page_release (p);
+  free (p);
+}
+
+/* Destroys the current process's supplemental page table,
+   releasing every page in it.  Memory-mapped files must already
+   be unmapped, since this does not close their files. */
+void
+page_table_destroy (void)
+{
+  hash_destroy (&thread_current ()->pages, page_destroy);
+}
+
+/* Returns the current process's page that contains user virtual
+   address ADDR, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *addr)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = pg_round_down (addr);
+  e = hash_find (&thread_current ()->pages, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Adds page UPAGE to the current process's supplemental page
+   table, to be loaded on first access from READ_BYTES bytes of
+   FILE starting at offset OFS, followed by zeros.  WRITABLE and
+   MMAP are as described in struct page.  A read-only page of a
+   file that is not memory-mapped, such as the code of an
+   executable, shares its frame with every other process that maps
+   the same part of the same file.  Returns the new page, or
+   a null pointer if UPAGE is already in the table or memory is
+   short. */
+struct page *
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable, bool mmap)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->writable = writable;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->mmap = mmap;
+  p->shared = !writable && !mmap;
+  lock_init (&p->lock);
+  p->frame = NULL;
+  p->swap_slot = SWAP_NONE;
+  if (hash_insert (&thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Adds writable page UPAGE, initially all zeros, to the current
+   process's supplemental page table.  Returns the new page, or a
+   null pointer if UPAGE is already in the table or memory is
+   short. */
+struct page *
+page_add_zero (void *upage)
+{
+  return page_add_file (upage, NULL, 0, 0, true, false);
+}
+
+/* Grows the current process's stack to cover user virtual
+   address ADDR, if ADDR is not in any page yet and looks like a
+   stack access by a process whose stack pointer is ESP.  That is
+   the case if ADDR is no more than 32 bytes below ESP, which the
+   PUSHA instruction can reach, and within the stack size limit.
+   The new page is zero-filled on first access.  Returns true if a
+   page was added. */
+bool
+page_grow_stack (const void *addr, const void *esp)
+{
+  const uint8_t *bottom = (const uint8_t *) PHYS_BASE - stack_limit;
+
+  if (!is_user_vaddr (addr) || (const uint8_t *) addr < bottom
+      || (const uint8_t *) addr + 32 < (const uint8_t *) esp
+      || page_lookup (addr) != NULL)
+    return false;
+  return page_add_zero (pg_round_down (addr)) != NULL;
+}
+
+/* Removes page P from the current process's supplemental page
+   table, releasing it as page_table_destroy() would. */
+void
+page_remove (struct page *p)
+{
+  hash_delete (&thread_current ()->pages, &p->hash_elem);
+  page_release (p);
+  free (p);
+}
+
+/* Reads page P, which is in swap and whose frame F is mapped but
+   not yet filled, back from swap.  The pages that follow P in
+   virtual memory and in swap come along in the same request, as
+   long as there are free frames for them, since a process that
+   touches one page is likely to touch its neighbors.  Caller must
+   hold P's lock. */
+static void
+swap_in_cluster (struct page *p, struct frame *f, uint32_t *pd)
+{
+  struct page *pages[SWAP_CLUSTER];
+  struct frame *frames[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t cnt, i;
+
+  pages[0] = p;
+  frames[0] = f;
+  kpages[0] = f->kpage;
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      struct page *q = page_lookup ((uint8_t *) p->upage + cnt * PGSIZE);
+      struct frame *g;
+
+      if (q == NULL || !lock_try_acquire (&q->lock))
+        break;
+      if (q->swap_slot != p->swap_slot + cnt
+          || (g = frame_try_alloc (q, pd)) == NULL)
+        {
+          lock_release (&q->lock);
+          break;
+        }
+      if (!pagedir_set_page (pd, q->upage, g->kpage, q->writable))
+        {
+          frame_free (g);
+          lock_release (&q->lock);
+          break;
+        }
+      pages[cnt] = q;
+      frames[cnt] = g;
+      kpages[cnt] = g->kpage;
+    }
+
+  swap_in (p->swap_slot, kpages, cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      pages[i]->swap_slot = SWAP_NONE;
+      pages[i]->frame = frames[i];
+      if (i > 0)
+        {
+          frame_unpin (frames[i]);
+          lock_release (&pages[i]->lock);
+        }
+    }
+}
+
+/* Brings page P, whose lock the caller must hold, into memory if
+   it is not there already, and pins its frame.  Returns true if
+   successful, false if memory is short or P's file cannot be
+   read. */
+static bool
+page_in (struct page *p)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct frame *f;
+
+  if (pagedir_get_page (pd, p->upage) != NULL)
+    {
+      if (p->frame != NULL)
+        frame_pin (p->frame);
+      return true;
+    }
+
+  if (p->shared)
+    {
+      void *kpage = share_get (p->file, p->ofs, p->read_bytes);
+      if (kpage == NULL)
+        return false;
+      if (!pagedir_set_page (pd, p->upage, kpage, false))
+        {
+          share_put (p->file, p->ofs, p->read_bytes);
+          return false;
+        }
+      return true;
+    }
+
+  f = frame_alloc (p, pd);
+  if (f == NULL)
+    return false;
+
+  /* Map the page before filling it, so that nothing is lost if
+     the page table cannot grow.  The process cannot see it until
+     we return. */
+  if (!pagedir_set_page (pd, p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+  if (p->swap_slot != SWAP_NONE)
+    swap_in_cluster (p, f, pd);
+  else
+    {
+      if (p->read_bytes > 0
+          && file_read_at (p->file, f->kpage, p->read_bytes, p->ofs)
+             != (off_t) p->read_bytes)
+        {
+          pagedir_clear_page (pd, p->upage);
+          frame_free (f);
+          return false;
+        }
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+      p->frame = f;
+    }
+  return true;
+}
+
+/* Brings the current process's page that contains user virtual
+   address ADDR into memory, if it is not there already.  Returns
+   true if successful, false if ADDR is not in any page of the
+   process or memory is short. */
+bool
+page_load (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+  bool success;
+
+  if (p == NULL)
+    return false;
+  lock_acquire (&p->lock);
+  success = page_in (p);
+  if (success && p->frame != NULL)
+    frame_unpin (p->frame);
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Like page_load(), but also keeps the page in memory until
+   page_unpin() is called for it, so that the kernel can access it
+   without faulting. */
+bool
+page_pin (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+  bool success;
+
+  if (p == NULL)
+    return false;
+  lock_acquire (&p->lock);
+  success = page_in (p);
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Lets the page that contains ADDR, pinned by page_pin(), be
+   evicted again. */
+void
+page_unpin (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+
+  if (p == NULL)
+    return;
+  lock_acquire (&p->lock);
+  if (p->frame != NULL)
+    frame_unpin (p->frame);
+  lock_release (&p->lock);
+}
+
+/* Evicts page P from frame F, writing it to its file or to swap
+   if its contents would otherwise be lost.  A clean page that can
+   be read again from its file is simply dropped.  Caller must hold
+   P's lock, and P may belong to any process.  Returns false,
+   leaving P in memory, if swap is full. */
+bool
+page_out (struct page *p, struct frame *f)
+{
+  uint32_t *pd = f->pagedir;
+  bool dirty;
+
+  /* Unmap first, so that the owner faults and waits for P's lock
+     instead of changing the page under us. */
+  pagedir_clear_page (pd, p->upage);
+  dirty = pagedir_is_dirty (pd, p->upage);
+
+  if (p->mmap)
+    {
+      if (dirty)
+        file_write_at (p->file, f->kpage, p->read_bytes, p->ofs);
+    }
+  else if (p->file == NULL || dirty)
+    {
+      size_t slot = swap_out (f->kpage);
+      if (slot == SWAP_NONE)
+        {
+          pagedir_set_page (pd, p->upage, f->kpage, p->writable);
+          pagedir_set_dirty (pd, p->upage, dirty);
+          return false;
+        }
+
+      /* From now on the page's contents live in swap, not in the
+         file it was first read from. */
+      p->swap_slot = slot;
+      p->file = NULL;
+      p->read_bytes = 0;
+    }
+  p->frame = NULL;
+  return true;
+}
+
+/* Returns a hash value for the page that E is embedded in. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
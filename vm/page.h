@@ -0,0 +1,62 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct frame;
+
+/* Default limit on the size of a user stack, in bytes. */
+#define STACK_DEFAULT_LIMIT (8 * 1024 * 1024)
+
+/* A page of a user process's virtual memory, as recorded in the
+   process's supplemental page table.  The page table proper maps
+   the page only while it is in memory; this records where its
+   contents come from when it is not. */
+struct page
+  {
+    struct hash_elem hash_elem;         /* Element in thread's `pages'. */
+    void *upage;                        /* User virtual address. */
+    bool writable;                      /* May the process write it? */
+
+    /* The first READ_BYTES bytes of the page come from FILE,
+       starting at offset OFS, and the rest are zeros.  If MMAP is
+       true, the page is part of a memory-mapped file, and changes
+       to it are written back to FILE when it is evicted or
+       unmapped.  A page without a FILE starts out as zeros. */
+    struct file *file;                  /* Backing file, if any. */
+    off_t ofs;                          /* Offset in FILE. */
+    size_t read_bytes;                  /* Bytes to read from FILE. */
+    bool mmap;                          /* Write back to FILE? */
+    bool shared;                        /* Frame shared with other
+                                           processes (vm/share.c)? */
+
+    /* Where the page is now.  Protected by LOCK, which is held
+       while the page moves in or out of memory. */
+    struct lock lock;                   /* Protects the members below. */
+    struct frame *frame;                /* Frame, if in memory and
+                                           not shared. */
+    size_t swap_slot;                   /* Swap slot, or SWAP_NONE. */
+  };
+
+void page_set_stack_limit (size_t bytes);
+
+bool page_table_init (void);
+void page_table_destroy (void);
+
+struct page *page_lookup (const void *);
+struct page *page_add_file (void *upage, struct file *, off_t ofs,
+                            size_t read_bytes, bool writable, bool mmap);
+struct page *page_add_zero (void *upage);
+bool page_grow_stack (const void *addr, const void *esp);
+void page_remove (struct page *);
+
+bool page_load (const void *);
+bool page_pin (const void *);
+void page_unpin (const void *);
+bool page_out (struct page *, struct frame *);
+
+#endif /* vm/page.h */
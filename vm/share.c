@@ -0,0 +1,193 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+
+/* Read-only pages of executables, shared by every process that
+   maps them.
+
+   A page is identified by the executable's inode, the offset of
+   the page's data in it, and the number of bytes read from there.
+   Executables cannot be written while they run, so a page read in
+   for one process is good for all of them.  Each page counts the
+   processes that map it and is freed when the last one lets it
+   go.  Shared frames are never evicted.
+
+   A page is entered into the table before it is read, marked as
+   loading, so that share_lock need not be held while a frame is
+   allocated, which may evict, or while the page is read.  Other
+   processes that want the same page meanwhile wait for it. */
+struct shared_page
+  {
+    struct hash_elem hash_elem;         /* Element in shared_pages. */
+    struct inode *inode;                /* Executable's inode. */
+    off_t ofs;                          /* Offset of data in INODE. */
+    size_t read_bytes;                  /* Bytes read from INODE. */
+    struct frame *frame;                /* The page's frame. */
+    int ref_cnt;                        /* Number of processes mapping it. */
+    bool loading;                       /* Being read in? */
+    struct condition loaded;            /* Signaled when read in. */
+  };
+
+/* All shared pages. */
+static struct hash shared_pages;
+
+/* Protects shared_pages and the pages in it. */
+static struct lock share_lock;
+
+static hash_hash_func shared_hash;
+static hash_less_func shared_less;
+
+/* Initializes the shared page cache. */
+void
+share_init (void)
+{
+  if (!hash_init (&shared_pages, shared_hash, shared_less, NULL))
+    PANIC ("can't allocate shared page table");
+  lock_init (&share_lock);
+}
+
+/* Returns the shared page whose key matches the given values, or
+   a null pointer if there is none.  Caller must hold share_lock. */
+static struct shared_page *
+shared_lookup (struct inode *inode, off_t ofs, size_t read_bytes)
+{
+  struct shared_page key;
+  struct hash_elem *e;
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  e = hash_find (&shared_pages, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct shared_page, hash_elem) : NULL;
+}
+
+/* Returns the frame of the read-only page that holds READ_BYTES
+   bytes of FILE starting at offset OFS, followed by zeros, reading
+   it in if no process maps it yet.  The caller must release it
+   with share_put().  Returns a null pointer if memory is short or
+   FILE cannot be read. */
+void *
+share_get (struct file *file, off_t ofs, size_t read_bytes)
+{
+  struct inode *inode = file_get_inode (file);
+  struct shared_page *sp;
+  struct frame *frame;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  lock_acquire (&share_lock);
+  sp = shared_lookup (inode, ofs, read_bytes);
+  if (sp != NULL)
+    {
+      /* Hold a reference while waiting, so that SP cannot be
+         freed under us if loading it fails. */
+      sp->ref_cnt++;
+      while (sp->loading)
+        cond_wait (&sp->loaded, &share_lock);
+      if (sp->frame == NULL)
+        {
+          if (--sp->ref_cnt == 0)
+            free (sp);
+          lock_release (&share_lock);
+          return NULL;
+        }
+      lock_release (&share_lock);
+      return sp->frame->kpage;
+    }
+
+  sp = malloc (sizeof *sp);
+  if (sp == NULL)
+    {
+      lock_release (&share_lock);
+      return NULL;
+    }
+  sp->inode = inode;
+  sp->ofs = ofs;
+  sp->read_bytes = read_bytes;
+  sp->frame = NULL;
+  sp->ref_cnt = 1;
+  sp->loading = true;
+  cond_init (&sp->loaded);
+  hash_insert (&shared_pages, &sp->hash_elem);
+  lock_release (&share_lock);
+
+  frame = frame_alloc (NULL, NULL);
+  if (frame != NULL)
+    {
+      if (file_read_at (file, frame->kpage, read_bytes, ofs)
+          == (off_t) read_bytes)
+        memset ((uint8_t *) frame->kpage + read_bytes, 0,
+                PGSIZE - read_bytes);
+      else
+        {
+          frame_free (frame);
+          frame = NULL;
+        }
+    }
+
+  lock_acquire (&share_lock);
+  sp->frame = frame;
+  sp->loading = false;
+  cond_broadcast (&sp->loaded, &share_lock);
+  if (frame == NULL)
+    {
+      /* Waiters drop their references and free SP when the last
+         of them is done with it. */
+      hash_delete (&shared_pages, &sp->hash_elem);
+      if (--sp->ref_cnt == 0)
+        free (sp);
+    }
+  lock_release (&share_lock);
+  return frame != NULL ? frame->kpage : NULL;
+}
+
+/* Releases a page obtained with share_get() for the same FILE,
+   OFS and READ_BYTES, freeing it if no other process maps it. */
+void
+share_put (struct file *file, off_t ofs, size_t read_bytes)
+{
+  struct shared_page *sp;
+
+  lock_acquire (&share_lock);
+  sp = shared_lookup (file_get_inode (file), ofs, read_bytes);
+  ASSERT (sp != NULL);
+  if (--sp->ref_cnt == 0)
+    {
+      hash_delete (&shared_pages, &sp->hash_elem);
+      frame_free (sp->frame);
+      free (sp);
+    }
+  lock_release (&share_lock);
+}
+
+/* Returns a hash value for the shared page that E is embedded
+   in. */
+static unsigned
+shared_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct shared_page *sp = hash_entry (e, struct shared_page,
+                                             hash_elem);
+  return hash_bytes (&sp->inode, sizeof sp->inode) ^ hash_int (sp->ofs);
+}
+
+/* Returns true if shared page A precedes shared page B. */
+static bool
+shared_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct shared_page *a = hash_entry (a_, struct shared_page,
+                                            hash_elem);
+  const struct shared_page *b = hash_entry (b_, struct shared_page,
+                                            hash_elem);
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
@@ -0,0 +1,13 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+
+void share_init (void);
+void *share_get (struct file *, off_t ofs, size_t read_bytes);
+void share_put (struct file *, off_t ofs, size_t read_bytes);
+
+#endif /* vm/share.h */
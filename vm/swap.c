@@ -0,0 +1,91 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The swap device is divided into page-sized slots.  A page is
+   written to or read from its slot with a single request, and
+   swap_in() reads a run of slots at once. */
+
+/* Number of sectors in a swap slot. */
+#define SLOT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;   /* Swap device, if any. */
+static struct bitmap *swap_map;     /* One bit per slot, true if used. */
+static size_t cursor;               /* Where the next search starts. */
+static struct lock swap_lock;       /* Protects swap_map and CURSOR. */
+
+/* Initializes the swap area.  Without a swap device, every
+   swap_out() fails. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SLOT_SECTORS;
+  swap_map = bitmap_create (slot_cnt);
+  if (swap_map == NULL)
+    PANIC ("can't allocate swap bitmap");
+  lock_init (&swap_lock);
+}
+
+/* Writes KPAGE to a free swap slot and returns the slot, or
+   SWAP_NONE if swap is full.  Slots are handed out next-fit, so
+   that pages evicted one after another land next to each other
+   and can be read back together. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, cursor, 1, false);
+  if (slot == BITMAP_ERROR)
+    slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    cursor = slot + 1;
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_NONE;
+
+  block_write_multiple (swap_device, slot * SLOT_SECTORS, SLOT_SECTORS,
+                        kpage);
+  return slot;
+}
+
+/* Reads the CNT consecutive slots starting at SLOT into the pages
+   in KPAGES, with a single request, and frees the slots. */
+void
+swap_in (size_t slot, void *kpages[], size_t cnt)
+{
+  struct block_iovec iov[SWAP_CLUSTER];
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT (bitmap_test (swap_map, slot + i));
+      iov[i].buffer = kpages[i];
+      iov[i].sector_cnt = SLOT_SECTORS;
+    }
+  block_readv (swap_device, slot * SLOT_SECTORS, iov, cnt);
+
+  lock_acquire (&swap_lock);
+  bitmap_set_multiple (swap_map, slot, cnt, false);
+  lock_release (&swap_lock);
+}
+
+/* Frees SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}
@@ -0,0 +1,18 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A swap slot that holds nothing. */
+#define SWAP_NONE SIZE_MAX
+
+/* Most pages swap_in() reads with one request. */
+#define SWAP_CLUSTER 8
+
+void swap_init (void);
+size_t swap_out (const void *kpage);
+void swap_in (size_t slot, void *kpages[], size_t cnt);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */